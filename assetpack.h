@@ -0,0 +1,132 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef ASSETPACK_H_
+#define ASSETPACK_H_
+
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "mmapfile.h"
+
+// The asset pack holds the style exemplars, the source guide and the icons
+// already resized to the resolutions the app uploads, as raw 8-bit pixels in
+// the row order of stbi_set_flip_vertically_on_load(1), so they go straight
+// from the mapped file to glTexImage2D. It is written by tools/packstyles.
+// Each entry remembers the size and modification time of the PNG it was made
+// from, and an entry whose PNG has changed since is ignored.
+//
+// layout: AssetPackHeader, numEntries x AssetPackEntry, pixel data (each
+// image starts at a multiple of assetPackAlignment)
+
+struct AssetPackHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t numEntries;
+};
+
+struct AssetPackEntry
+{
+  char     name[64];
+  uint32_t width;
+  uint32_t height;
+  uint32_t numChannels;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t sourceSize;
+  uint64_t sourceTime;
+};
+
+static const char assetPackMagic[8] = { 'S','B','P','A','C','K','\0','\0' };
+static const uint32_t assetPackVersion = 2;
+static const int assetPackAlignment = 16;
+
+// Resolution ladder of the exemplars and the guide (a quarter octave apart)
+// and the resolution of the icons.
+static const int assetPackSizes[] = { 128, 152, 181, 215, 256, 304, 362, 431, 512 };
+static const int assetPackNumSizes = sizeof(assetPackSizes)/sizeof(assetPackSizes[0]);
+static const int assetPackIconSize = 92;
+
+static inline const AssetPackEntry* assetPackEntries(const MappedFile& pack,uint32_t* out_numEntries)
+{
+  *out_numEntries = 0;
+  if (!pack.data || pack.size<sizeof(AssetPackHeader)) { return 0; }
+
+  AssetPackHeader header;
+  memcpy(&header,pack.data,sizeof(header));
+  if (memcmp(header.magic,assetPackMagic,sizeof(header.magic))!=0 ||
+      header.version!=assetPackVersion ||
+      pack.size<sizeof(AssetPackHeader)+sizeof(AssetPackEntry)*size_t(header.numEntries)) { return 0; }
+
+  *out_numEntries = header.numEntries;
+  return (const AssetPackEntry*)(pack.data+sizeof(AssetPackHeader));
+}
+
+// Size and modification time of a source image as stored in its entries.
+static inline bool sourceFileStamp(const char* fileName,uint64_t* out_size,uint64_t* out_time)
+{
+  struct stat st;
+  if (stat(fileName,&st)!=0) { return false; }
+  *out_size = uint64_t(st.st_size);
+  *out_time = uint64_t(st.st_mtime);
+  return true;
+}
+
+// Returns the pixels of the image made from sourceFileName (looked up by its
+// name without the directory) at the given resolution, or 0 when the pack
+// doesn't have it or the source file has changed since it was packed. When
+// the source file doesn't exist the packed image is used as it is.
+static inline const unsigned char* findPackedImage(const MappedFile& pack,const char* sourceFileName,int width,int height,int numChannels)
+{
+  if (width<=0 || height<=0 || numChannels<=0) { return 0; }
+
+  uint32_t numEntries;
+  const AssetPackEntry* entries = assetPackEntries(pack,&numEntries);
+
+  const char* name = sourceFileName;
+  for(const char* c=sourceFileName;*c;c++) { if (*c=='/' || *c=='\\') { name = c+1; } }
+
+  uint64_t sourceSize = 0;
+  uint64_t sourceTime = 0;
+  const bool sourceExists = sourceFileStamp(sourceFileName,&sourceSize,&sourceTime);
+
+  for(uint32_t i=0;i<numEntries;i++)
+  {
+    const AssetPackEntry& entry = entries[i];
+    if (strncmp(entry.name,name,sizeof(entry.name))==0 &&
+        entry.width==uint32_t(width) &&
+        entry.height==uint32_t(height) &&
+        entry.numChannels==uint32_t(numChannels) &&
+        entry.size==uint64_t(width)*height*numChannels &&
+        entry.offset<=pack.size && entry.size<=pack.size-entry.offset)
+    {
+      // the web build's preloaded files don't keep their modification time
+#ifdef __EMSCRIPTEN__
+      if (sourceExists && entry.sourceSize!=sourceSize) { return 0; }
+#else
+      if (sourceExists && (entry.sourceSize!=sourceSize || entry.sourceTime!=sourceTime)) { return 0; }
+#endif
+      return pack.data+entry.offset;
+    }
+  }
+
+  return 0;
+}
+
+// Picks the ladder resolution closest to the requested one.
+static inline int nearestPackedSize(int size)
+{
+  int nearest = assetPackSizes[0];
+  for(int i=1;i<assetPackNumSizes;i++)
+  {
+    if (abs(assetPackSizes[i]-size)<abs(nearest-size)) { nearest = assetPackSizes[i]; }
+  }
+  return nearest;
+}
+
+#endif
@@ -0,0 +1,266 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef AUTOTUNE_H_
+#define AUTOTUNE_H_
+
+// Finds the quality/performance presets of a style (see presets.h) on a test
+// sequence of guides. Every combination of threshold, blend radius, coarsest
+// level, resolution scale and seed layout stylizes the sequence while GPU
+// timestamps measure the main and the blend pass (see styleblitPassTimes),
+// and the guide error is taken
+// by blending the source guide through the same NNF instead of the style: the
+// result is the guide the stylized frame actually follows, and its mean
+// difference to the target guide (in the units of threshold) is the error.
+// At lower scales it's compared at full resolution, so the lost detail counts.
+// The error alone would always favor the lowest threshold, which matches
+// pixel by pixel and loses the texture of the style, so the mean chunk size
+// (from styleblitStats, in output pixels) is the third objective. What
+// remains are the settings no other setting beats in all three.
+// Desktop only. Expects stb_image.h to be included before.
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "styleblit.h"
+#include "presets.h"
+#include "sequence.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+static const float tuneThresholds[] = { 8.0f,16.0f,24.0f,32.0f,48.0f };
+static const int tuneBlendRadii[] = { 0,1,2,3 };
+static const int tuneCoarsestLevels[] = { 4,5,6 };
+static const float tuneScales[] = { 1.0f,0.75f,0.5f };
+
+#define TUNE_COUNT(array) int(sizeof(array)/sizeof(array[0]))
+
+static bool comparePresetTimes(const Preset& a,const Preset& b)
+{
+  if (a.ms!=b.ms) { return a.ms<b.ms; }
+  return a.error<b.error;
+}
+
+// Differences within the tolerance don't count: the timings are noisy, and
+// a slower preset has to be visibly better to be worth listing.
+static const float tuneTolerance = 0.05f;
+
+static bool dominates(const Preset& a,const Preset& b)
+{
+  return a.error<=b.error*(1.0f+tuneTolerance) && a.chunkSize*(1.0f+tuneTolerance)>=b.chunkSize;
+}
+
+// The frontier of presets sorted fastest first: going from the fastest, a
+// preset is kept unless one already kept is as good in error and chunk size.
+// The default is the one closest to the ideal of the least time, the least
+// error and the largest chunks, each normalized to the range it spans on the
+// frontier.
+static void paretoFrontier(std::vector<Preset> presets,std::vector<Preset>* out_frontier,int* out_defaultPreset)
+{
+  std::sort(presets.begin(),presets.end(),comparePresetTimes);
+
+  std::vector<Preset> frontier;
+  for(int i=0;i<presets.size();i++)
+  {
+    bool dominated = false;
+    for(int j=0;j<frontier.size() && !dominated;j++) { dominated = dominates(frontier[j],presets[i]); }
+    if (!dominated) { frontier.push_back(presets[i]); }
+  }
+
+  Preset lo = frontier[0];
+  Preset hi = frontier[0];
+  for(int i=1;i<frontier.size();i++)
+  {
+    lo.ms = std::min(lo.ms,frontier[i].ms);             hi.ms = std::max(hi.ms,frontier[i].ms);
+    lo.error = std::min(lo.error,frontier[i].error);    hi.error = std::max(hi.error,frontier[i].error);
+    lo.chunkSize = std::min(lo.chunkSize,frontier[i].chunkSize); hi.chunkSize = std::max(hi.chunkSize,frontier[i].chunkSize);
+  }
+
+  int defaultPreset = 0;
+  float bestDistance = 1e30f;
+  for(int i=0;i<frontier.size();i++)
+  {
+    const float t = (frontier[i].ms-lo.ms)/std::max(hi.ms-lo.ms,1e-6f);
+    const float e = (frontier[i].error-lo.error)/std::max(hi.error-lo.error,1e-6f);
+    const float c = (hi.chunkSize-frontier[i].chunkSize)/std::max(hi.chunkSize-lo.chunkSize,1e-6f);
+    if (t*t+e*e+c*c<bestDistance) { bestDistance = t*t+e*e+c*c; defaultPreset = i; }
+  }
+
+  *out_frontier = frontier;
+  *out_defaultPreset = defaultPreset;
+}
+
+// Sweeps the settings over options.numFrames guides. loadSource(targetHeight,
+// &texStyle,&texNormals,&sourceSize) provides the exemplar and its guide at
+// the source size the app uses for a target of that height, so the chunks
+// keep their size on screen at every scale.
+template<typename F>
+static bool tunePresets(const SequenceOptions& options,
+                        const F& loadSource,
+                        std::vector<Preset>* out_presets,
+                        int* out_defaultPreset)
+{
+  if (options.numFrames<=0) { return false; }
+
+  int width,height;
+  const std::string firstFileName = frameFileName(options.guidePattern,options.firstFrame);
+  if (!stbi_info(firstFileName.c_str(),&width,&height,NULL)) { fprintf(stderr,"failed to load %s\n",firstFileName.c_str()); return false; }
+
+  std::vector<std::vector<unsigned char> > guides(options.numFrames);
+  stbi_set_flip_vertically_on_load(1);
+  for(int i=0;i<options.numFrames;i++)
+  {
+    guides[i].resize(size_t(width)*height*4);
+    if (!loadSequenceFrame(options,options.firstFrame+i,width,height,guides[i].data())) { return false; }
+  }
+
+  std::vector<Preset> presets;
+  std::vector<unsigned char> scaledGuide;
+  std::vector<unsigned char> reconstruction;
+
+  printf("threshold radius level scale grid    main ms  blend ms   error   chunk\n");
+
+  for(int s=0;s<TUNE_COUNT(tuneScales);s++)
+  {
+    const float scale = tuneScales[s];
+    const int scaledWidth = std::max(int(width*scale+0.5f),1);
+    const int scaledHeight = std::max(int(height*scale+0.5f),1);
+
+    GLuint texStyle,texNormals;
+    int sourceSize;
+    if (!loadSource(scaledHeight,&texStyle,&texNormals,&sourceSize)) { return false; }
+
+    // the guides are point sampled down, the mask has to stay binary
+    std::vector<GLuint> texGuides(options.numFrames);
+    glGenTextures(options.numFrames,texGuides.data());
+    scaledGuide.resize(size_t(scaledWidth)*scaledHeight*4);
+    for(int i=0;i<options.numFrames;i++)
+    {
+      for(int y=0;y<scaledHeight;y++)
+      for(int x=0;x<scaledWidth;x++)
+      {
+        const int sx = std::min(int((x+0.5f)*width/scaledWidth),width-1);
+        const int sy = std::min(int((y+0.5f)*height/scaledHeight),height-1);
+        memcpy(&scaledGuide[(size_t(y)*scaledWidth+x)*4],&guides[i][(size_t(sy)*width+sx)*4],4);
+      }
+      glBindTexture(GL_TEXTURE_2D,texGuides[i]);
+      glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,scaledWidth,scaledHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,scaledGuide.data());
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    }
+
+    GLuint texOutputs[2],fboOutputs[2];
+    glGenTextures(2,texOutputs);
+    glGenFramebuffers(2,fboOutputs);
+    for(int i=0;i<2;i++)
+    {
+      glBindTexture(GL_TEXTURE_2D,texOutputs[i]);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,scaledWidth,scaledHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+      glBindFramebuffer(GL_FRAMEBUFFER,fboOutputs[i]);
+      glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,texOutputs[i],0);
+    }
+    const GLuint fboStylized = fboOutputs[0];
+    const GLuint fboReconstructed = fboOutputs[1];
+    reconstruction.resize(size_t(scaledWidth)*scaledHeight*4);
+
+    for(int t=0;t<TUNE_COUNT(tuneThresholds);t++)
+    for(int r=0;r<TUNE_COUNT(tuneBlendRadii);r++)
+    for(int l=0;l<TUNE_COUNT(tuneCoarsestLevels);l++)
+    for(int grid=0;grid<2;grid++)
+    {
+      Preset preset;
+      preset.threshold = tuneThresholds[t];
+      preset.blendRadius = tuneBlendRadii[r];
+      preset.coarsestLevel = tuneCoarsestLevels[l];
+      preset.scale = scale;
+      preset.grid = (grid!=0);
+      const int flags = presetFlags(preset);
+
+      double mainMs = 0;
+      double blendMs = 0;
+      double error = 0;
+      double chunkSize = 0;
+      long long numPixels = 0;
+
+      // the first call compiles the programs of the setting and draws the
+      // seeds, every setting gets the same ones
+      srand(1);
+      for(int i=-1;i<options.numFrames;i++)
+      {
+        const int frame = std::max(i,0);
+        glViewport(0,0,scaledWidth,scaledHeight);
+
+        glBindFramebuffer(GL_FRAMEBUFFER,fboStylized);
+        styleblit(scaledWidth,scaledHeight,texGuides[frame],sourceSize,sourceSize,texNormals,texStyle,preset.threshold,preset.blendRadius,i<0,flags|STYLEBLIT_PASS_TIMES);
+        float frameMainMs = 0;
+        float frameBlendMs = 0;
+        styleblitPassTimes(&frameMainMs,&frameBlendMs);
+
+        // the statistics (and without blending the NNF) take a different,
+        // slower path than the one timed, with the same seeds
+        styleblit(scaledWidth,scaledHeight,texGuides[frame],sourceSize,sourceSize,texNormals,texStyle,preset.threshold,preset.blendRadius,false,flags|STYLEBLIT_LEVEL_STATS);
+        StyleblitStats stats;
+        if (!styleblitStats(&stats)) { stats.numPixels = stats.numChunks = 0; }
+
+        glBindFramebuffer(GL_FRAMEBUFFER,fboReconstructed);
+        styleblitBlend(scaledWidth,scaledHeight,texGuides[frame],styleblitNNF(),sourceSize,sourceSize,texNormals,preset.blendRadius);
+
+        glPixelStorei(GL_PACK_ALIGNMENT,1);
+        glReadPixels(0,0,scaledWidth,scaledHeight,GL_RGBA,GL_UNSIGNED_BYTE,reconstruction.data());
+
+        if (i<0) { continue; }
+
+        mainMs += frameMainMs;
+        blendMs += frameBlendMs;
+        chunkSize += double(stats.numPixels)/std::max(stats.numChunks,1)/(scale*scale);
+
+        const std::vector<unsigned char>& guide = guides[frame];
+        for(int y=0;y<height;y++)
+        for(int x=0;x<width;x++)
+        {
+          const unsigned char* g = &guide[(size_t(y)*width+x)*4];
+          if (g[3]==0) { continue; }
+          const int sx = std::min(x*scaledWidth/width,scaledWidth-1);
+          const int sy = std::min(y*scaledHeight/height,scaledHeight-1);
+          const unsigned char* c = &reconstruction[(size_t(sy)*scaledWidth+sx)*4];
+          error += std::abs(int(g[0])-int(c[0]))+std::abs(int(g[1])-int(c[1]))+std::abs(int(g[2])-int(c[2]));
+          numPixels++;
+        }
+      }
+
+      preset.ms = float((mainMs+blendMs)/options.numFrames);
+      preset.error = float(error/std::max(numPixels,1LL));
+      preset.chunkSize = float(chunkSize/options.numFrames);
+      presets.push_back(preset);
+
+      printf("%9g %6d %5d %5.2f %4d %10.2f %9.2f %7.2f %7.1f\n",preset.threshold,preset.blendRadius,preset.coarsestLevel,preset.scale,grid,
+             mainMs/options.numFrames,blendMs/options.numFrames,preset.error,preset.chunkSize);
+      fflush(stdout);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+    glDeleteFramebuffers(2,fboOutputs);
+    glDeleteTextures(2,texOutputs);
+    glDeleteTextures(options.numFrames,texGuides.data());
+  }
+
+  paretoFrontier(presets,out_presets,out_defaultPreset);
+  return true;
+}
+
+#undef TUNE_COUNT
+
+#endif
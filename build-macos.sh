@@ -1,2 +1,5 @@
 #!/bin/sh
 clang main.cpp styleblit/styleblit.cpp glfw3/src/context.c glfw3/src/init.c glfw3/src/input.c glfw3/src/monitor.c glfw3/src/vulkan.c glfw3/src/osmesa_context.c glfw3/src/egl_context.c glfw3/src/nsgl_context.m glfw3/src/cocoa_init.m glfw3/src/cocoa_joystick.m glfw3/src/cocoa_monitor.m  glfw3/src/cocoa_time.c glfw3/src/cocoa_window.m glfw3/src/posix_thread.c glfw3/src/window.c glew/src/glew.c -I"." -I"styleblit" -I"glfw3/include" -I"glew/include" -D_GLFW_COCOA -DGLEW_STATIC -DNDEBUG -O2 -lstdc++ -framework Cocoa -framework IOKit -framework CoreVideo -framework OpenGL -o styleblitapp
+clang tools/buildlut.cpp -I"." -DNDEBUG -O2 -lstdc++ -o buildlut
+clang tools/packstyles.cpp -I"." -DNDEBUG -O2 -lstdc++ -o packstyles
+clang tools/stylizeclient.cpp -I"." -DNDEBUG -O2 -lstdc++ -o stylizeclient
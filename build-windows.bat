@@ -41,6 +41,22 @@ opengl32.lib ^
 /EHsc ^
 /Fe"styleblit.exe" ^
 /nologo || goto error
+
+cl tools\buildlut.cpp ^
+/I"." ^
+/DNDEBUG ^
+/O2 ^
+/EHsc ^
+/Fe"buildlut.exe" ^
+/nologo || goto error
+
+cl tools\packstyles.cpp ^
+/I"." ^
+/DNDEBUG ^
+/O2 ^
+/EHsc ^
+/Fe"packstyles.exe" ^
+/nologo || goto error
 :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::
 goto :EOF
 
@@ -0,0 +1,334 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+// Server side of the stylization daemon, see daemonclient.h for the protocol.
+// It owns the GL context, the compiled programs and the loaded styles for as
+// long as it runs, so a request costs the clients a memcpy into shared memory
+// and a round trip over the socket. The sockets are nonblocking and every
+// connection keeps its partly received request and partly sent reply, so a
+// slow client never holds up the others. Requests that arrive together are
+// served grouped by frame size and then by style, so the target textures and
+// the NNF are reallocated and the styles switched as rarely as possible.
+// POSIX only.
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "styleblit.h"
+#include "daemonprotocol.h"
+
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+
+struct DaemonConnection
+{
+  int            socket;
+  char           frameName[32];
+  unsigned char* frame;
+  size_t         frameSize;
+  DaemonRequest  request;
+  size_t         requestReceived;  // bytes of request read so far
+  DaemonReply    reply;
+  size_t         replyPending;     // bytes of reply still to be sent
+};
+
+struct PendingRequest
+{
+  int           connection;
+  DaemonRequest request;
+};
+
+static volatile sig_atomic_t daemonStopped = 0;
+
+static void stopDaemon(int) { daemonStopped = 1; }
+
+static void unmapDaemonFrame(DaemonConnection* connection)
+{
+  if (connection->frame) { munmap(connection->frame,connection->frameSize); }
+  connection->frame = 0;
+  connection->frameSize = 0;
+  connection->frameName[0] = 0;
+}
+
+// The client keeps using one segment until it has to grow, so it's mapped
+// once and not on every request.
+static bool mapDaemonFrame(DaemonConnection* connection,const char* frameName)
+{
+  if (connection->frame && strcmp(connection->frameName,frameName)==0) { return true; }
+
+  unmapDaemonFrame(connection);
+
+  const int file = shm_open(frameName,O_RDWR,0);
+  if (file<0) { return false; }
+  struct stat st;
+  if (fstat(file,&st)!=0 || st.st_size==0) { close(file); return false; }
+  void* frame = mmap(0,st.st_size,PROT_READ|PROT_WRITE,MAP_SHARED,file,0);
+  close(file);
+  if (frame==MAP_FAILED) { return false; }
+
+  connection->frame = (unsigned char*)frame;
+  connection->frameSize = st.st_size;
+  strncpy(connection->frameName,frameName,sizeof(connection->frameName)-1);
+  connection->frameName[sizeof(connection->frameName)-1] = 0;
+  return true;
+}
+
+// A new frame size reallocates the guide and output textures here and the NNF
+// inside styleblit(), which costs more than switching styles, so the size
+// decides first.
+static bool comparePendingRequests(const PendingRequest& a,const PendingRequest& b)
+{
+  if (a.request.width!=b.request.width) { return a.request.width<b.request.width; }
+  if (a.request.height!=b.request.height) { return a.request.height<b.request.height; }
+  const int styleOrder = strncmp(a.request.style,b.request.style,sizeof(a.request.style));
+  if (styleOrder!=0) { return styleOrder<0; }
+  return a.request.sourceSize<b.request.sourceSize;
+}
+
+static void closeDaemonConnection(DaemonConnection* connection)
+{
+  close(connection->socket);
+  unmapDaemonFrame(connection);
+  connection->socket = -1;
+}
+
+static bool setNonblocking(int socket)
+{
+  const int flags = fcntl(socket,F_GETFL,0);
+  return flags>=0 && fcntl(socket,F_SETFL,flags|O_NONBLOCK)==0;
+}
+
+// Whether something already sits at socketPath that bind() would fail on, and
+// removes it only if it is the socket of a daemon that is gone: a socket file
+// nobody accepts connections on.
+static bool socketPathTaken(const char* socketPath,const sockaddr_un& address)
+{
+  struct stat st;
+  if (lstat(socketPath,&st)!=0) { return false; }
+  if (!S_ISSOCK(st.st_mode)) { return true; }
+
+  const int probe = socket(AF_UNIX,SOCK_STREAM,0);
+  if (probe<0) { return true; }
+  const bool refused = connect(probe,(const sockaddr*)&address,sizeof(address))!=0 && errno==ECONNREFUSED;
+  close(probe);
+
+  if (!refused) { return true; }
+  return unlink(socketPath)!=0;
+}
+
+// Serves requests on socketPath until SIGINT or SIGTERM. loadStyle(style,size,
+// &texStyle,&texNormals,&actualSize) provides the exemplar and its guide at
+// (roughly) the requested source size and should cache them.
+template<typename F>
+static bool runDaemon(const char* socketPath,const F& loadStyle)
+{
+  signal(SIGPIPE,SIG_IGN);
+  signal(SIGINT,stopDaemon);
+  signal(SIGTERM,stopDaemon);
+
+  const int listener = socket(AF_UNIX,SOCK_STREAM,0);
+  if (listener<0) { return false; }
+
+  sockaddr_un address;
+  memset(&address,0,sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path,socketPath,sizeof(address.sun_path)-1);
+  if (socketPathTaken(socketPath,address))
+  {
+    fprintf(stderr,"%s is in use\n",socketPath);
+    close(listener);
+    return false;
+  }
+  if (bind(listener,(const sockaddr*)&address,sizeof(address))!=0 || listen(listener,16)!=0 || !setNonblocking(listener))
+  {
+    fprintf(stderr,"failed to listen on %s\n",socketPath);
+    close(listener);
+    return false;
+  }
+
+  GLuint texGuide = 0;
+  GLuint texOutput = 0;
+  GLuint fboOutput = 0;
+  int frameWidth = 0;
+  int frameHeight = 0;
+
+  std::vector<DaemonConnection> connections;
+  std::vector<PendingRequest> pendingRequests;
+  std::vector<pollfd> pollFiles;
+
+  while (!daemonStopped)
+  {
+    // a connection either waits for (the rest of) a request or has a reply
+    // to send, the clients don't send another request before the reply
+    pollFiles.resize(connections.size()+1);
+    pollFiles[0].fd = listener;
+    pollFiles[0].events = POLLIN;
+    for(int i=0;i<connections.size();i++)
+    {
+      pollFiles[i+1].fd = connections[i].socket;
+      pollFiles[i+1].events = (connections[i].replyPending>0) ? POLLOUT : POLLIN;
+    }
+    if (poll(pollFiles.data(),pollFiles.size(),-1)<0) { continue; }
+
+    // every request completed in this round goes into one batch
+    pendingRequests.clear();
+    for(int i=0;i<connections.size();i++)
+    {
+      DaemonConnection& connection = connections[i];
+      const short events = pollFiles[i+1].revents;
+
+      if (connection.replyPending>0)
+      {
+        if (events & (POLLHUP|POLLERR)) { closeDaemonConnection(&connection); continue; }
+        if (!(events & POLLOUT)) { continue; }
+        const char* bytes = (const char*)&connection.reply+sizeof(connection.reply)-connection.replyPending;
+        const ssize_t sent = send(connection.socket,bytes,connection.replyPending,0);
+        if (sent<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)) { continue; }
+        if (sent<=0) { closeDaemonConnection(&connection); continue; }
+        connection.replyPending -= sent;
+        continue;
+      }
+
+      if (!(events & (POLLIN|POLLHUP|POLLERR))) { continue; }
+      char* bytes = (char*)&connection.request+connection.requestReceived;
+      const ssize_t received = recv(connection.socket,bytes,sizeof(connection.request)-connection.requestReceived,0);
+      if (received<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)) { continue; }
+      if (received<=0) { closeDaemonConnection(&connection); continue; }
+      connection.requestReceived += received;
+      if (connection.requestReceived<sizeof(connection.request)) { continue; }
+
+      connection.requestReceived = 0;
+      if (connection.request.magic!=daemonMagic || connection.request.version!=daemonVersion) { closeDaemonConnection(&connection); continue; }
+
+      PendingRequest pending;
+      pending.connection = i;
+      pending.request = connection.request;
+      pending.request.frameName[sizeof(pending.request.frameName)-1] = 0;
+      pending.request.style[sizeof(pending.request.style)-1] = 0;
+      pendingRequests.push_back(pending);
+    }
+    std::stable_sort(pendingRequests.begin(),pendingRequests.end(),comparePendingRequests);
+
+    for(int i=0;i<pendingRequests.size();i++)
+    {
+      const DaemonRequest& request = pendingRequests[i].request;
+      DaemonConnection& connection = connections[pendingRequests[i].connection];
+      const int width = request.width;
+      const int height = request.height;
+
+      DaemonReply& reply = connection.reply;
+      reply.status = 0;
+
+      GLuint texStyle = 0;
+      GLuint texNormals = 0;
+      int sourceSize = 0;
+      if (width<=0 || height<=0 || !mapDaemonFrame(&connection,request.frameName) || size_t(width)*height*4>connection.frameSize) { reply.status = 1; }
+      else if (!loadStyle(request.style,(request.sourceSize>0) ? request.sourceSize : height/4,&texStyle,&texNormals,&sourceSize)) { reply.status = 2; }
+
+      if (reply.status==0)
+      {
+        if (width!=frameWidth || height!=frameHeight)
+        {
+          if (texGuide==0)
+          {
+            glGenTextures(1,&texGuide);
+            glGenTextures(1,&texOutput);
+            glGenFramebuffers(1,&fboOutput);
+          }
+          glBindTexture(GL_TEXTURE_2D,texGuide);
+          glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,width,height,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+          glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+          glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+          glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+          glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+          glBindTexture(GL_TEXTURE_2D,texOutput);
+          glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,width,height,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+          glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+          glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+          glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+          glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,texOutput,0);
+          frameWidth = width;
+          frameHeight = height;
+        }
+
+        glBindTexture(GL_TEXTURE_2D,texGuide);
+        glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+        glTexSubImage2D(GL_TEXTURE_2D,0,0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,connection.frame);
+
+        glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+        glViewport(0,0,width,height);
+
+        styleblit(width,
+                  height,
+                  texGuide,
+                  sourceSize,
+                  sourceSize,
+                  texNormals,
+                  texStyle,
+                  request.threshold,
+                  request.blendRadius,
+                  request.jitter!=0);
+
+        glPixelStorei(GL_PACK_ALIGNMENT,1);
+        glReadPixels(0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,connection.frame);
+        glBindFramebuffer(GL_FRAMEBUFFER,0);
+      }
+
+      // sent once the socket reports it can take it
+      connection.replyPending = sizeof(connection.reply);
+    }
+
+    for(int i=int(connections.size())-1;i>=0;i--)
+    {
+      if (connections[i].socket<0) { connections.erase(connections.begin()+i); }
+    }
+
+    if (pollFiles[0].revents & POLLIN)
+    {
+      DaemonConnection connection;
+      memset(&connection,0,sizeof(connection));
+      connection.socket = accept(listener,0,0);
+      if (connection.socket>=0 && !setNonblocking(connection.socket)) { close(connection.socket); connection.socket = -1; }
+      if (connection.socket>=0) { connections.push_back(connection); }
+    }
+  }
+
+  for(int i=0;i<connections.size();i++)
+  {
+    close(connections[i].socket);
+    unmapDaemonFrame(&connections[i]);
+  }
+  close(listener);
+  unlink(socketPath);
+
+  if (texGuide!=0)
+  {
+    glDeleteFramebuffers(1,&fboOutput);
+    glDeleteTextures(1,&texOutput);
+    glDeleteTextures(1,&texGuide);
+  }
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,165 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef DAEMONCLIENT_H_
+#define DAEMONCLIENT_H_
+
+// Client side of the stylization daemon (styleblit --daemon <socket>), for
+// tools that want stylized frames without creating a GL context themselves.
+// The guide goes through a POSIX shared memory segment owned by the client,
+// the control socket only carries fixed-size request and reply records, and
+// the daemon writes the result over the guide in place:
+//
+//   DaemonClient client;
+//   connectDaemon("/tmp/styleblit.sock",&client);
+//   unsigned char* pixels = daemonFrameBuffer(&client,width,height);
+//   ... fill pixels with the RGBA guide ...
+//   stylizeOnDaemon(&client,width,height,"03b.png",24.0f,1,true);
+//   ... pixels now hold the RGBA result ...
+//   disconnectDaemon(&client);
+//
+// Rows are bottom-up, as GL uploads and reads them. tools/stylizeclient.cpp
+// is a complete example. POSIX only.
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "daemonprotocol.h"
+
+static bool sendAll(int socket,const void* data,size_t size)
+{
+  const char* bytes = (const char*)data;
+  while (size>0)
+  {
+    const ssize_t sent = send(socket,bytes,size,0);
+    if (sent<=0) { return false; }
+    bytes += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+static bool receiveAll(int socket,void* data,size_t size)
+{
+  char* bytes = (char*)data;
+  while (size>0)
+  {
+    const ssize_t received = recv(socket,bytes,size,0);
+    if (received<=0) { return false; }
+    bytes += received;
+    size -= received;
+  }
+  return true;
+}
+
+struct DaemonClient
+{
+  int            socket;
+  int            frameFile;
+  unsigned char* frame;
+  size_t         frameSize;
+  char           frameName[32];
+  int            numFrameNames;
+};
+
+static bool connectDaemon(const char* socketPath,DaemonClient* client)
+{
+  client->frameFile = -1;
+  client->frame = 0;
+  client->frameSize = 0;
+  client->frameName[0] = 0;
+  client->numFrameNames = 0;
+
+  client->socket = ::socket(AF_UNIX,SOCK_STREAM,0);
+  if (client->socket<0) { return false; }
+
+  sockaddr_un address;
+  memset(&address,0,sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path,socketPath,sizeof(address.sun_path)-1);
+  if (connect(client->socket,(const sockaddr*)&address,sizeof(address))!=0) { close(client->socket); client->socket = -1; return false; }
+
+  return true;
+}
+
+static void releaseDaemonFrame(DaemonClient* client)
+{
+  if (!client->frame) { return; }
+  munmap(client->frame,client->frameSize);
+  close(client->frameFile);
+  shm_unlink(client->frameName);
+  client->frame = 0;
+  client->frameSize = 0;
+}
+
+// Returns the shared buffer for a width x height RGBA frame. It's only
+// reallocated (under a new name) when it has to grow.
+static unsigned char* daemonFrameBuffer(DaemonClient* client,int width,int height)
+{
+  const size_t size = size_t(width)*height*4;
+  if (client->frame && size<=client->frameSize) { return client->frame; }
+
+  releaseDaemonFrame(client);
+
+  snprintf(client->frameName,sizeof(client->frameName),"/styleblit-%d-%d",int(getpid()),client->numFrameNames++);
+  client->frameFile = shm_open(client->frameName,O_RDWR|O_CREAT|O_EXCL,0600);
+  if (client->frameFile<0) { return 0; }
+  if (ftruncate(client->frameFile,size)!=0) { close(client->frameFile); shm_unlink(client->frameName); return 0; }
+  void* frame = mmap(0,size,PROT_READ|PROT_WRITE,MAP_SHARED,client->frameFile,0);
+  if (frame==MAP_FAILED) { close(client->frameFile); shm_unlink(client->frameName); return 0; }
+
+  client->frame = (unsigned char*)frame;
+  client->frameSize = size;
+  return client->frame;
+}
+
+// Stylizes the guide in the frame buffer in place; blocks until it's done.
+// Fails for style names that don't fit the request.
+static bool stylizeOnDaemon(DaemonClient* client,
+                            int width,
+                            int height,
+                            const char* style,
+                            float threshold,
+                            int blendRadius,
+                            bool jitter,
+                            int sourceSize = 0)
+{
+  if (!client->frame || size_t(width)*height*4>client->frameSize) { return false; }
+  if (strlen(style)>=sizeof(DaemonRequest::style)) { return false; }
+
+  DaemonRequest request;
+  memset(&request,0,sizeof(request));
+  request.magic = daemonMagic;
+  request.version = daemonVersion;
+  snprintf(request.frameName,sizeof(request.frameName),"%s",client->frameName);
+  snprintf(request.style,sizeof(request.style),"%s",style);
+  request.width = width;
+  request.height = height;
+  request.sourceSize = sourceSize;
+  request.blendRadius = blendRadius;
+  request.jitter = jitter ? 1 : 0;
+  request.threshold = threshold;
+
+  DaemonReply reply;
+  return sendAll(client->socket,&request,sizeof(request)) &&
+         receiveAll(client->socket,&reply,sizeof(reply)) &&
+         reply.status==0;
+}
+
+static void disconnectDaemon(DaemonClient* client)
+{
+  releaseDaemonFrame(client);
+  if (client->socket>=0) { close(client->socket); }
+  client->socket = -1;
+}
+
+#endif
@@ -0,0 +1,36 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef DAEMONPROTOCOL_H_
+#define DAEMONPROTOCOL_H_
+
+// Records exchanged over the control socket of the stylization daemon,
+// shared by daemon.h and daemonclient.h. A client sends one DaemonRequest and
+// waits for its DaemonReply before sending the next one.
+
+#include <stdint.h>
+
+static const uint32_t daemonMagic = 0x42535453; // "STSB"
+static const uint32_t daemonVersion = 1;
+
+struct DaemonRequest
+{
+  uint32_t magic;
+  uint32_t version;
+  char     frameName[32];  // shared memory segment holding the frame
+  char     style[64];      // exemplar in the daemon's data/ directory
+  int32_t  width;
+  int32_t  height;
+  int32_t  sourceSize;     // 0 picks a quarter of the frame height
+  int32_t  blendRadius;
+  int32_t  jitter;
+  float    threshold;
+};
+
+struct DaemonReply
+{
+  int32_t status;          // 0 on success
+};
+
+#endif
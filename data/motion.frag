@@ -0,0 +1,28 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifdef GL_ES
+precision highp float;
+#endif
+
+uniform vec2 targetSize;
+
+varying vec4 previousPosition;
+
+float frac(float x) { return x-floor(x); }
+
+vec4 pack(vec2 xy)
+{
+  float x = xy.x/255.0;
+  float y = xy.y/255.0;
+  return vec4(frac(x),floor(x)/255.0,
+              frac(y),floor(y)/255.0);
+}
+
+void main()
+{
+  vec2 previous = (previousPosition.xy/previousPosition.w*0.5+vec2(0.5,0.5))*targetSize;
+  vec2 motion = floor(gl_FragCoord.xy-previous+vec2(0.5,0.5));
+  gl_FragColor = pack(clamp(motion,vec2(-32000.0,-32000.0),vec2(32000.0,32000.0))+vec2(32768.0,32768.0));
+}
@@ -0,0 +1,19 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+uniform mat4 projviewMatrix;
+uniform mat4 previousProjviewMatrix;
+uniform vec3 positionMin;
+uniform vec3 positionExtent;
+
+attribute vec3 position;
+
+varying vec4 previousPosition;
+
+void main()
+{
+  vec4 p = vec4(positionMin+position*positionExtent,1.0);
+  gl_Position = projviewMatrix*p;
+  previousPosition = previousProjviewMatrix*p;
+}
@@ -4,15 +4,28 @@
 
 uniform mat4 projviewMatrix;
 uniform mat4 normalMatrix;
+uniform vec3 positionMin;
+uniform vec3 positionExtent;
 
 attribute vec3 position;
-attribute vec3 normal;
+attribute vec2 normal;
 
 varying vec3 color;
 
+vec3 decodeOctahedral(vec2 e)
+{
+  vec3 n = vec3(e.x,e.y,1.0-abs(e.x)-abs(e.y));
+  if (n.z<0.0)
+  {
+    n.xy = (vec2(1.0,1.0)-abs(n.yx))*vec2(n.x>=0.0 ? 1.0 : -1.0,
+                                         n.y>=0.0 ? 1.0 : -1.0);
+  }
+  return normalize(n);
+}
+
 void main()
 {
-  gl_Position = projviewMatrix*vec4(position,1.0);
-  vec4 n = normalMatrix*vec4(normal,0.0);
+  gl_Position = projviewMatrix*vec4(positionMin+position*positionExtent,1.0);
+  vec4 n = normalMatrix*vec4(decodeOctahedral(normal),0.0);
   color = n.xyz*0.5+vec3(0.5,0.5,0.5);
 }
@@ -0,0 +1,53 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifdef GL_ES
+precision highp float;
+#endif
+
+#define MAX_FOOTPRINT 32
+
+uniform sampler2D image;
+uniform vec2 imageSize;
+uniform vec2 targetSize;
+
+void main()
+{
+  vec2 scale = imageSize/targetSize;
+
+  // enlarging: plain bilinear
+  if (scale.x<=1.0 && scale.y<=1.0)
+  {
+    gl_FragColor = texture2D(image,gl_FragCoord.xy/targetSize);
+    return;
+  }
+
+  // shrinking: average the texels under the pixel's footprint, each weighted
+  // by how much of it they cover
+  vec2 p0 = (gl_FragCoord.xy-vec2(0.5,0.5))*scale;
+  vec2 p1 = p0+scale;
+  vec2 first = floor(p0);
+
+  vec4 sumColor = vec4(0.0,0.0,0.0,0.0);
+  float sumWeight = 0.0;
+
+  for(int y=0;y<MAX_FOOTPRINT;y++)
+  {
+    float ty = first.y+float(y);
+    if (ty>=p1.y) { break; }
+    float wy = min(ty+1.0,p1.y)-max(ty,p0.y);
+
+    for(int x=0;x<MAX_FOOTPRINT;x++)
+    {
+      float tx = first.x+float(x);
+      if (tx>=p1.x) { break; }
+      float wx = min(tx+1.0,p1.x)-max(tx,p0.x);
+
+      sumColor += texture2D(image,(vec2(tx,ty)+vec2(0.5,0.5))/imageSize)*(wx*wy);
+      sumWeight += wx*wy;
+    }
+  }
+
+  gl_FragColor = sumColor/sumWeight;
+}
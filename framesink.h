@@ -0,0 +1,290 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef FRAMESINK_H_
+#define FRAMESINK_H_
+
+// Destinations for stylized frames: numbered PPM files, or a single stream
+// (a file, a named pipe or stdout) of YUV4MPEG2 or raw RGBA frames that can be
+// piped straight into an encoder, e.g.
+//
+//   styleblit --sequence guides/%04d.png y4m:- 0 100 | ffmpeg -i - out.mp4
+//
+// or a stream of the NNFs instead of the pixels (see nnfcodec.h).
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "nnfcodec.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#include <emmintrin.h>
+#define FRAMESINK_SSE2
+#endif
+
+// The frames come bottom-up as read back from GL, tightly packed RGBA.
+struct FrameSink
+{
+  virtual ~FrameSink() { }
+  virtual bool writeFrame(int frame,int width,int height,const unsigned char* pixels) = 0;
+
+  // Sinks that want the NNF (see styleblitNNF) and the guide of each frame
+  // rather than the stylized pixels get them through writeNNF instead.
+  virtual bool wantsNNF() const { return false; }
+  virtual bool writeNNF(int,int,int,int,int,const unsigned char*,const unsigned char*) { return false; }
+};
+
+static std::string frameFileName(const char* pattern,int frame)
+{
+  std::vector<char> fileName(strlen(pattern)+32);
+  snprintf(fileName.data(),fileName.size(),pattern,frame);
+  return std::string(fileName.data());
+}
+
+struct PPMSink : FrameSink
+{
+  std::string pattern;
+  std::vector<unsigned char> row;
+
+  PPMSink(const char* pattern) : pattern(pattern) { }
+
+  bool writeFrame(int frame,int width,int height,const unsigned char* pixels)
+  {
+    FILE* f = fopen(frameFileName(pattern.c_str(),frame).c_str(),"wb");
+    if (!f) { return false; }
+    fprintf(f,"P6\n%d %d\n255\n",width,height);
+    row.resize(width*3);
+    bool ok = true;
+    for(int y=height-1;y>=0;y--)
+    {
+      const unsigned char* src = &pixels[size_t(y)*width*4];
+      for(int x=0;x<width;x++) { memcpy(&row[x*3],&src[x*4],3); }
+      ok = ok && fwrite(row.data(),row.size(),1,f)==1;
+    }
+    return (fclose(f)==0) && ok;
+  }
+};
+
+// "-" is stdout, anything else is opened as a file, which is also how named
+// pipes (mkfifo on POSIX, \\.\pipe\name on Windows) are written.
+static FILE* openFrameStream(const char* fileName)
+{
+  if (strcmp(fileName,"-")!=0) { return fopen(fileName,"wb"); }
+#if defined(_WIN32)
+  _setmode(_fileno(stdout),_O_BINARY);
+#endif
+  return stdout;
+}
+
+struct StreamSink : FrameSink
+{
+  FILE* stream;
+
+  StreamSink(const char* fileName) : stream(openFrameStream(fileName))
+  {
+    if (stream) { setvbuf(stream,0,_IOFBF,1<<20); }
+  }
+
+  ~StreamSink()
+  {
+    if (stream && stream!=stdout) { fclose(stream); }
+    else if (stream) { fflush(stream); }
+  }
+};
+
+struct RawRGBASink : StreamSink
+{
+  RawRGBASink(const char* fileName) : StreamSink(fileName) { }
+
+  bool writeFrame(int,int width,int height,const unsigned char* pixels)
+  {
+    if (!stream) { return false; }
+    for(int y=height-1;y>=0;y--)
+    {
+      if (fwrite(&pixels[size_t(y)*width*4],width*4,1,stream)!=1) { return false; }
+    }
+    return true;
+  }
+};
+
+// BT.601 limited range in 8-bit fixed point. The chroma is taken from the 2x2
+// block average, rounded the way _mm_avg_epu8 does so both paths agree.
+static inline int yFromRGB(int r,int g,int b) { return (( 66*r+129*g+ 25*b+128)>>8)+16;  }
+static inline int uFromRGB(int r,int g,int b) { return ((-38*r- 74*g+112*b+128)>>8)+128; }
+static inline int vFromRGB(int r,int g,int b) { return ((112*r- 94*g- 18*b+128)>>8)+128; }
+
+static inline unsigned char average(unsigned char a,unsigned char b) { return (a+b+1)>>1; }
+
+#ifdef FRAMESINK_SSE2
+// Dot products of four RGBA pixels with (cr,cg,cb,0), rounded and shifted
+// down by 8 bits.
+static inline __m128i dotRGB4(__m128i pixels,__m128i coefficients)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels,zero),coefficients);
+  const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels,zero),coefficients);
+  const __m128 evens = _mm_shuffle_ps(_mm_castsi128_ps(lo),_mm_castsi128_ps(hi),_MM_SHUFFLE(2,0,2,0));
+  const __m128 odds  = _mm_shuffle_ps(_mm_castsi128_ps(lo),_mm_castsi128_ps(hi),_MM_SHUFFLE(3,1,3,1));
+  const __m128i sum = _mm_add_epi32(_mm_castps_si128(evens),_mm_castps_si128(odds));
+  return _mm_srai_epi32(_mm_add_epi32(sum,_mm_set1_epi32(128)),8);
+}
+#endif
+
+static void lumaRow(const unsigned char* rgba,int width,unsigned char* dst)
+{
+  int x = 0;
+#ifdef FRAMESINK_SSE2
+  const __m128i coefficients = _mm_setr_epi16(66,129,25,0,66,129,25,0);
+  const __m128i offset = _mm_set1_epi32(16);
+  for(;x+16<=width;x+=16)
+  {
+    __m128i y[4];
+    for(int i=0;i<4;i++)
+    {
+      y[i] = _mm_add_epi32(dotRGB4(_mm_loadu_si128((const __m128i*)&rgba[(x+i*4)*4]),coefficients),offset);
+    }
+    const __m128i y16 = _mm_packs_epi32(y[0],y[1]);
+    const __m128i y16b = _mm_packs_epi32(y[2],y[3]);
+    _mm_storeu_si128((__m128i*)&dst[x],_mm_packus_epi16(y16,y16b));
+  }
+#endif
+  for(;x<width;x++) { dst[x] = yFromRGB(rgba[x*4+0],rgba[x*4+1],rgba[x*4+2]); }
+}
+
+// Chroma of one row of 2x2 blocks; row1 is the same as row0 for the last row
+// of an odd-height frame, an odd width repeats the last column.
+static void chromaRow(const unsigned char* row0,const unsigned char* row1,int width,unsigned char* dstU,unsigned char* dstV)
+{
+  const int chromaWidth = (width+1)/2;
+  int x = 0;
+#ifdef FRAMESINK_SSE2
+  const __m128i coefficientsU = _mm_setr_epi16(-38,-74,112,0,-38,-74,112,0);
+  const __m128i coefficientsV = _mm_setr_epi16(112,-94,-18,0,112,-94,-18,0);
+  const __m128i offset = _mm_set1_epi32(128);
+  for(;x+4<=width/2;x+=4)
+  {
+    __m128i half[2];
+    for(int i=0;i<2;i++)
+    {
+      const __m128i v = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)&row0[(x*2+i*4)*4]),
+                                     _mm_loadu_si128((const __m128i*)&row1[(x*2+i*4)*4]));
+      half[i] = _mm_shuffle_epi32(_mm_avg_epu8(v,_mm_srli_epi64(v,32)),_MM_SHUFFLE(3,1,2,0));
+    }
+    const __m128i blocks = _mm_unpacklo_epi64(half[0],half[1]);
+    const __m128i u = _mm_add_epi32(dotRGB4(blocks,coefficientsU),offset);
+    const __m128i v = _mm_add_epi32(dotRGB4(blocks,coefficientsV),offset);
+    const __m128i uv = _mm_packus_epi16(_mm_packs_epi32(u,v),_mm_setzero_si128());
+    const int packedU = _mm_cvtsi128_si32(uv);
+    const int packedV = _mm_cvtsi128_si32(_mm_srli_si128(uv,4));
+    memcpy(&dstU[x],&packedU,4);
+    memcpy(&dstV[x],&packedV,4);
+  }
+#endif
+  for(;x<chromaWidth;x++)
+  {
+    const int x0 = x*2;
+    const int x1 = std::min(x*2+1,width-1);
+    int rgb[3];
+    for(int c=0;c<3;c++)
+    {
+      rgb[c] = average(average(row0[x0*4+c],row1[x0*4+c]),average(row0[x1*4+c],row1[x1*4+c]));
+    }
+    dstU[x] = std::min(std::max(uFromRGB(rgb[0],rgb[1],rgb[2]),0),255);
+    dstV[x] = std::min(std::max(vFromRGB(rgb[0],rgb[1],rgb[2]),0),255);
+  }
+}
+
+// YUV4MPEG2 in 4:2:0, the format ffmpeg and x264 read from a pipe directly.
+struct Y4MSink : StreamSink
+{
+  int framesPerSecond;
+  bool headerWritten;
+  std::vector<unsigned char> planes;
+
+  Y4MSink(const char* fileName,int framesPerSecond) : StreamSink(fileName),framesPerSecond(framesPerSecond),headerWritten(false) { }
+
+  bool writeFrame(int,int width,int height,const unsigned char* pixels)
+  {
+    if (!stream) { return false; }
+    if (!headerWritten)
+    {
+      fprintf(stream,"YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",width,height,framesPerSecond);
+      headerWritten = true;
+    }
+
+    const int chromaWidth = (width+1)/2;
+    const int chromaHeight = (height+1)/2;
+    planes.resize(size_t(width)*height+size_t(chromaWidth)*chromaHeight*2);
+    unsigned char* planeY = planes.data();
+    unsigned char* planeU = planeY+size_t(width)*height;
+    unsigned char* planeV = planeU+size_t(chromaWidth)*chromaHeight;
+
+    const size_t stride = size_t(width)*4;
+    for(int y=0;y<height;y++)
+    {
+      lumaRow(&pixels[(height-1-y)*stride],width,&planeY[size_t(y)*width]);
+    }
+    for(int y=0;y<chromaHeight;y++)
+    {
+      const unsigned char* row0 = &pixels[(height-1-y*2)*stride];
+      const unsigned char* row1 = &pixels[std::max(height-2-y*2,0)*stride];
+      chromaRow(row0,row1,width,&planeU[size_t(y)*chromaWidth],&planeV[size_t(y)*chromaWidth]);
+    }
+
+    return fwrite("FRAME\n",6,1,stream)==1 && fwrite(planes.data(),planes.size(),1,stream)==1;
+  }
+};
+
+// A keyframe every keyframeInterval frames, the rest delta coded.
+struct NNFSink : StreamSink
+{
+  NNFEncoder encoder;
+  int keyframeInterval;
+  bool headerWritten;
+  std::vector<unsigned char> record;
+
+  NNFSink(const char* fileName,int keyframeInterval) : StreamSink(fileName),keyframeInterval(keyframeInterval),headerWritten(false) { }
+
+  bool wantsNNF() const { return true; }
+
+  bool writeFrame(int,int,int,const unsigned char*) { return false; }
+
+  bool writeNNF(int frame,int width,int height,int sourceWidth,int sourceHeight,const unsigned char* nnf,const unsigned char* guide)
+  {
+    if (!stream) { return false; }
+    if (!headerWritten)
+    {
+      NNFStreamHeader header = { width,height,sourceWidth,sourceHeight };
+      if (!writeNNFStreamHeader(stream,header)) { return false; }
+      createNNFEncoder(&encoder,width,height,keyframeInterval);
+      headerWritten = true;
+    }
+    if (width!=encoder.width || height!=encoder.height) { return false; }
+
+    record.clear();
+    encodeNNFFrame(&encoder,frame,nnf,guide,&record);
+    return fwrite(record.data(),record.size(),1,stream)==1;
+  }
+};
+
+// "y4m:<file>" and "rgba:<file>" stream into one file ("-" is stdout),
+// "nnf:<file>" stores the NNFs with a keyframe every second, anything else
+// is a printf pattern of numbered PPM files.
+static FrameSink* createFrameSink(const char* output,int framesPerSecond)
+{
+  if (strncmp(output,"nnf:",4)==0)  { return new NNFSink(output+4,framesPerSecond); }
+  if (strncmp(output,"y4m:",4)==0)  { return new Y4MSink(output+4,framesPerSecond); }
+  if (strncmp(output,"rgba:",5)==0) { return new RawRGBASink(output+5); }
+  return new PPMSink(output);
+}
+
+#endif
@@ -18,9 +18,17 @@
 #include "styleblit.h"
 
 #include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <stdint.h>
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <atomic>
+#ifndef __EMSCRIPTEN__
+#include <thread>
+#endif
 
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
@@ -31,15 +39,32 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-#include "stb_image_resize.h"
-
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
+#include "mmapfile.h"
+#include "assetpack.h"
+#include "presets.h"
+#ifndef __EMSCRIPTEN__
+#include "sequence.h"
+#include "tiled.h"
+#include "autotune.h"
+#endif
+#if !defined(__EMSCRIPTEN__) && !defined(_WIN32)
+#include "daemon.h"
+#endif
+
 float threshold = 24.0f;
 int jitter = 12;
 int blendRadius = 1;
+int coarsestLevel = 6;
+bool gridSeeds = false;
+float renderScale = 1.0f;
+bool statsRequested = false;
+
+// the presets of the current style, see presets.h
+std::vector<Preset> presets;
+int currentPreset = -1;
 
 int sourceSize = 235;
 
@@ -49,20 +74,42 @@ int targetHeight = -1;
 GLuint texSourceStyle = 0;
 GLuint texSourceNormals = 0;
 GLuint texTargetNormals = 0;
+GLuint texTargetMotion = 0;
+GLuint texOutput = 0;
 
 GLuint fbo = 0;
 GLuint depthBuffer = 0;
 
 GLuint vaoModel = 0;
-int numModelVerts = 0;
+int numModelIndices = 0;
+glm::vec3 modelPositionMin;
+glm::vec3 modelPositionExtent;
 
 GLuint progDrawNormals = 0;
+GLuint progDrawMotion = 0;
 
 std::vector<std::string> styles;
 
 std::vector<GLuint> texStyleIcons;
+int currentStyle = 0;
+float currentStyleScale = 0;
+
+// Exemplars and guides as decoded from the PNGs, kept at their native
+// resolution so that a change of scale is just a GPU resampling pass.
+struct NativeImage
+{
+  std::string fileName;
+  GLuint      texture;
+  int         width;
+  int         height;
+};
+
+std::vector<NativeImage> nativeImages;
+
+MappedFile assetPack;
 
 glm::mat4 viewMatrix;
+glm::mat4 previousProjViewMatrix;
 glm::vec3 lookAt;
 
 GLFWwindow* window;
@@ -91,23 +138,10 @@ static GLuint createTexture2D(GLint format,int width,int height,const void* data
   return texture;
 }
 
-static GLuint loadTexture(const std::string& fileName,GLint format,const int resolution,GLint filter)
+// With an asset pack, the source resolution snaps to the closest one it holds.
+static int styleSourceSize(int size)
 {
-  const int numChannels = (format==GL_RGBA) ? 4 : 3;
-  int width;
-  int height;
- 
-  stbi_set_flip_vertically_on_load(1);  
-  unsigned char* image = stbi_load(fileName.c_str(),&width,&height,NULL,numChannels);
-  unsigned char* resizedImage = new unsigned char[resolution*resolution*numChannels];
-  stbir_resize_uint8(image,width,height,0,resizedImage,resolution,resolution,0,numChannels);
-
-  GLuint texture = createTexture2D(format,resolution,resolution,resizedImage,filter,GL_CLAMP_TO_EDGE);
-
-  delete[] resizedImage;
-  stbi_image_free(image);
-
-  return texture;
+  return assetPack.data ? nearestPackedSize(size) : size;
 }
 
 static void bindFBO(GLuint fbo,GLuint texture,GLuint depthBuffer)
@@ -161,6 +195,10 @@ static GLuint createProgram(const char* vertexShaderFileName,
   glAttachShader(program,vertexShader);
   glAttachShader(program,fragmentShader);
 
+  // position is always attribute 0, so that the normals pass and the motion
+  // pass can draw the model from the same vertex array
+  glBindAttribLocation(program,0,"position");
+
   glLinkProgram(program);
 
   GLint linkStatus;
@@ -189,8 +227,241 @@ static GLuint createProgram(const char* vertexShaderFileName,
   return program;
 }
 
-static GLuint createVertexArrayFromOBJ(const std::string& objFileName,GLuint positionLocation,GLuint normalLocation,int* numModelVerts)
-{ 
+// Returns 0 if the image can't be decoded; the failure isn't cached, so a
+// fixed file gets picked up the next time.
+static const NativeImage* loadNativeImage(const std::string& fileName)
+{
+  for(int i=0;i<nativeImages.size();i++)
+  {
+    if (nativeImages[i].fileName==fileName) { return &nativeImages[i]; }
+  }
+
+  NativeImage nativeImage;
+  nativeImage.fileName = fileName;
+
+  stbi_set_flip_vertically_on_load(1);
+  unsigned char* image = stbi_load(fileName.c_str(),&nativeImage.width,&nativeImage.height,NULL,4);
+  if (!image) { fprintf(stderr,"failed to load %s\n",fileName.c_str()); return 0; }
+  nativeImage.texture = createTexture2D(GL_RGBA,nativeImage.width,nativeImage.height,image,GL_LINEAR,GL_CLAMP_TO_EDGE);
+  stbi_image_free(image);
+
+  nativeImages.push_back(nativeImage);
+  return &nativeImages.back();
+}
+
+// Renders a resolution x resolution copy of the image through an area-weighted
+// box filter. The copy is always RGBA, which unlike RGB is guaranteed to be
+// renderable in WebGL.
+static GLuint resampleTexture(const NativeImage& image,const int resolution,GLint filter)
+{
+  static GLuint prog = 0;
+  static GLuint fboResample = 0;
+  static GLuint vbo = 0;
+  static GLuint vao = 0;
+
+  if (prog==0)
+  {
+    prog = createProgram("data/resample.vert","data/resample.frag");
+    glGenFramebuffers(1,&fboResample);
+
+    const float vertices[] = { -1.0f, -1.0f,
+                               +3.0f, -1.0f,
+                               -1.0f, +3.0f };
+    glGenBuffers(1,&vbo);
+    glBindBuffer(GL_ARRAY_BUFFER,vbo);
+    glBufferData(GL_ARRAY_BUFFER,sizeof(vertices),vertices,GL_STATIC_DRAW);
+
+    glGenVertexArrays(1,&vao);
+    glBindVertexArray(vao);
+    glVertexAttribPointer(glGetAttribLocation(prog,"position"),2,GL_FLOAT,GL_FALSE,0,0);
+    glEnableVertexAttribArray(glGetAttribLocation(prog,"position"));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+  }
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT,viewport);
+
+  const GLuint texture = createTexture2D(GL_RGBA,resolution,resolution,0,filter,GL_CLAMP_TO_EDGE);
+
+  glBindFramebuffer(GL_FRAMEBUFFER,fboResample);
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,texture,0);
+  glViewport(0,0,resolution,resolution);
+
+  glUseProgram(prog);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D,image.texture);
+  glUniform1i(glGetUniformLocation(prog,"image"),0);
+  glUniform2f(glGetUniformLocation(prog,"imageSize"),image.width,image.height);
+  glUniform2f(glGetUniformLocation(prog,"targetSize"),resolution,resolution);
+
+  glBindVertexArray(vao);
+  glDrawArrays(GL_TRIANGLES,0,3);
+  glBindVertexArray(0);
+
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,0,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+  glViewport(viewport[0],viewport[1],viewport[2],viewport[3]);
+
+  return texture;
+}
+
+// Takes the image from the asset pack when it has it at this resolution,
+// otherwise resamples the native image (decoded only on first use) on the GPU.
+static GLuint loadTexture(const std::string& fileName,GLint format,const int resolution,GLint filter)
+{
+  const int numChannels = (format==GL_RGBA) ? 4 : 3;
+
+  const unsigned char* packedImage = findPackedImage(assetPack,fileName.c_str(),resolution,resolution,numChannels);
+  if (packedImage) { return createTexture2D(format,resolution,resolution,packedImage,filter,GL_CLAMP_TO_EDGE); }
+
+  const NativeImage* nativeImage = loadNativeImage(fileName);
+  if (!nativeImage)
+  {
+    // shown as transparent black rather than as whatever the texture held
+    const std::vector<unsigned char> blank(size_t(resolution)*resolution*numChannels,0);
+    return createTexture2D(format,resolution,resolution,blank.data(),filter,GL_CLAMP_TO_EDGE);
+  }
+  return resampleTexture(*nativeImage,resolution,filter);
+}
+
+// Source resolution of a style for a target of the given height; some of the
+// exemplars are used at a smaller scale than the others.
+static int styleSourceSize(const std::string& style,int targetHeight)
+{
+  const bool large = (style=="0.png" || style=="01c.png" || style=="03b.png" || style=="12b.png" || style=="new12.png");
+  return styleSourceSize(large ? targetHeight/4 : targetHeight/3);
+}
+
+static std::string stylePresetsFileName(const std::string& style)
+{
+  return "data/"+style.substr(0,style.find_last_of('.'))+".presets";
+}
+
+static void applyPreset(int preset)
+{
+  const Preset& p = presets[preset];
+  threshold = p.threshold;
+  blendRadius = p.blendRadius;
+  coarsestLevel = p.coarsestLevel;
+  gridSeeds = p.grid;
+  renderScale = p.scale;
+  currentPreset = preset;
+}
+
+// (Re)loads the exemplar and the source guide of the current style for the
+// current render scale.
+static void loadStyleTextures()
+{
+  const int style = currentStyle;
+
+  glDeleteTextures(1,&texSourceStyle);
+  glDeleteTextures(1,&texSourceNormals);
+
+  sourceSize = styleSourceSize(styles[style],int(windowHeight*renderScale));
+
+  texSourceStyle   = loadTexture("data/"+styles[style],GL_RGB,sourceSize,GL_NEAREST);
+  texSourceNormals = loadTexture("data/normals.png",GL_RGB,sourceSize,GL_NEAREST);
+  styleblitInvalidate();
+
+  currentStyleScale = renderScale;
+}
+
+// Switches to a style and its presets, if it has any; without them the
+// settings stay as they are.
+static void selectStyle(int style)
+{
+  int defaultPreset = 0;
+  if (loadPresets(stylePresetsFileName(styles[style]).c_str(),&presets,&defaultPreset)) { applyPreset(defaultPreset); }
+  else { presets.clear(); currentPreset = -1; }
+
+  currentStyle = style;
+  loadStyleTextures();
+}
+
+// Vertex format of the normals pass. The position is stored as 16-bit unorm
+// within the mesh bounding box and dequantized in normals.vert, the normal is
+// octahedral-encoded into two 16-bit snorms. That's 12 bytes per vertex
+// instead of 24 for two float vec3 streams.
+struct PackedVertex
+{
+  uint16_t position[4];
+  int16_t  normal[2];
+};
+
+// The mesh cache stores the processed (centered, scaled, smooth-shaded) mesh as
+// GPU-ready vertex and index streams laid out right after the header, so later
+// runs can upload it straight from the mapped file without parsing.
+struct MeshCacheHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t numVertices;
+  uint32_t numIndices;
+  uint32_t reserved;
+  uint64_t sourceSize;
+  uint64_t sourceHash;
+  float    positionMin[3];
+  float    positionExtent[3];
+};
+
+static const char meshCacheMagic[8] = { 'S','B','M','E','S','H','\0','\0' };
+static const uint32_t meshCacheVersion = 3;
+
+static uint64_t hashBytes(const unsigned char* data,size_t size)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for(size_t i=0;i<size;i++) { hash = (hash^data[i])*1099511628211ULL; }
+  return hash;
+}
+
+template<typename F>
+static void parallelFor(int count,const F& body)
+{
+#ifdef __EMSCRIPTEN__
+  for(int i=0;i<count;i++) { body(i); }
+#else
+  const int numThreads = std::min(count,std::max(int(std::thread::hardware_concurrency()),1));
+  std::atomic<int> next(0);
+  std::vector<std::thread> threads;
+  for(int t=1;t<numThreads;t++)
+  {
+    threads.push_back(std::thread([&]() { for(int i=next++;i<count;i=next++) { body(i); } }));
+  }
+  for(int i=next++;i<count;i=next++) { body(i); }
+  for(int t=0;t<threads.size();t++) { threads[t].join(); }
+#endif
+}
+
+// Decodes the images on all cores and uploads them at native resolution, so
+// that loadTexture() later finds them in nativeImages and only resamples.
+static void preloadNativeImages(const std::vector<std::string>& fileNames)
+{
+  std::vector<NativeImage> decodedImages(fileNames.size());
+  std::vector<unsigned char*> pixels(fileNames.size(),(unsigned char*)0);
+
+  stbi_set_flip_vertically_on_load(1);
+  parallelFor(fileNames.size(),[&](int i)
+  {
+    pixels[i] = stbi_load(fileNames[i].c_str(),&decodedImages[i].width,&decodedImages[i].height,NULL,4);
+  });
+
+  for(int i=0;i<fileNames.size();i++)
+  {
+    if (!pixels[i]) { continue; }
+    NativeImage& nativeImage = decodedImages[i];
+    nativeImage.fileName = fileNames[i];
+    nativeImage.texture = createTexture2D(GL_RGBA,nativeImage.width,nativeImage.height,pixels[i],GL_LINEAR,GL_CLAMP_TO_EDGE);
+    stbi_image_free(pixels[i]);
+    nativeImages.push_back(nativeImage);
+  }
+}
+
+#ifdef __EMSCRIPTEN__
+static bool parseOBJ(const std::string& objFileName,
+                     std::vector<glm::vec3>* out_vertices,
+                     std::vector<glm::ivec3>* out_triangles)
+{
   tinyobj::attrib_t attrib;
   std::vector<tinyobj::shape_t> shapes;
   std::vector<tinyobj::material_t> materials;
@@ -198,9 +469,9 @@ static GLuint createVertexArrayFromOBJ(const std::string& objFileName,GLuint pos
   std::string err;
   bool ret = tinyobj::LoadObj(&attrib,&shapes,&materials,&err,objFileName.c_str(),"",true);
 
-  if (!err.empty()) { return 0; }
+  if (!err.empty()) { return false; }
 
-  if (!ret) { return 0; }
+  if (!ret) { return false; }
 
   int numTriangles = 0;
   for (int s=0;s<shapes.size();s++)
@@ -208,7 +479,8 @@ static GLuint createVertexArrayFromOBJ(const std::string& objFileName,GLuint pos
     numTriangles += shapes[s].mesh.num_face_vertices.size();
   }
   
-  std::vector<glm::ivec3> triangles = std::vector<glm::ivec3>(numTriangles);
+  std::vector<glm::ivec3>& triangles = *out_triangles;
+  triangles = std::vector<glm::ivec3>(numTriangles);
   int triangleIndex = 0;
   for (int s=0;s<shapes.size();s++)
   {
@@ -222,7 +494,8 @@ static GLuint createVertexArrayFromOBJ(const std::string& objFileName,GLuint pos
   }
 
   const int numVertices = attrib.vertices.size()/3;
-  std::vector<glm::vec3> vertices = std::vector<glm::vec3>(numVertices);
+  std::vector<glm::vec3>& vertices = *out_vertices;
+  vertices = std::vector<glm::vec3>(numVertices);
   for (int i=0;i<numVertices;i++)
   {
     vertices[i] = glm::vec3(attrib.vertices[i*3+0],
@@ -230,84 +503,529 @@ static GLuint createVertexArrayFromOBJ(const std::string& objFileName,GLuint pos
                             attrib.vertices[i*3+1]);
   }
 
+  return true;
+}
+#endif
+
+// Vertices and triangles parsed from one line-aligned chunk of an OBJ file.
+// Relative (negative) face indices can't be resolved until the number of
+// vertices in the preceding chunks is known, so they are stored relative to
+// the start of the chunk and their positions are remembered for the merge.
+struct OBJChunk
+{
+  std::vector<glm::vec3>  vertices;
+  std::vector<glm::ivec3> triangles;
+  std::vector<int>        relativeCorners;
+};
+
+static bool isOBJSpace(char c)   { return c==' ' || c=='\t'; }
+static bool isOBJNewLine(char c) { return c=='\r' || c=='\n' || c=='\0'; }
+
+static const char* skipOBJSpaces(const char* s,const char* end)
+{
+  while (s<end && isOBJSpace(*s)) { s++; }
+  return s;
+}
+
+static const char* skipOBJToken(const char* s,const char* end,bool stopAtSlash)
+{
+  while (s<end && !isOBJSpace(*s) && !isOBJNewLine(*s) && !(stopAtSlash && *s=='/')) { s++; }
+  return s;
+}
+
+// Same number parser as tinyobj, so both paths produce bit-identical vertices.
+static float parseOBJFloat(const char** token,const char* end)
+{
+  const char* s = skipOBJSpaces(*token,end);
+  const char* e = skipOBJToken(s,end,false);
+  double value = 0.0;
+  tinyobj::tryParseDouble(s,e,&value);
+  *token = e;
+  return float(value);
+}
+
+// Mirrors atoi() followed by skipping the rest of the index, as tinyobj does.
+static int parseOBJIndex(const char** token,const char* end)
+{
+  const char* s = *token;
+  int sign = 1;
+  if (s<end && (*s=='+' || *s=='-')) { if (*s=='-') { sign = -1; } s++; }
+  int value = 0;
+  while (s<end && *s>='0' && *s<='9') { value = value*10+(*s-'0'); s++; }
+  *token = skipOBJToken(s,end,true);
+  return sign*value;
+}
+
+static void parseOBJLine(const char* s,const char* end,OBJChunk* chunk,std::vector<int>* face)
+{
+  s = skipOBJSpaces(s,end);
+  if (end-s<2) { return; }
+
+  if (s[0]=='v' && isOBJSpace(s[1]))
+  {
+    s += 2;
+    const float x = parseOBJFloat(&s,end);
+    const float y = parseOBJFloat(&s,end);
+    const float z = parseOBJFloat(&s,end);
+    chunk->vertices.push_back(glm::vec3(x,z,y));
+  }
+  else if (s[0]=='f' && isOBJSpace(s[1]))
+  {
+    s = skipOBJSpaces(s+2,end);
+
+    face->clear();
+    while (s<end && !isOBJNewLine(*s))
+    {
+      face->push_back(parseOBJIndex(&s,end));
+      // skip texcoord and normal indices
+      while (s<end && *s=='/') { s++; s = skipOBJToken(s,end,true); }
+      while (s<end && (isOBJSpace(*s) || *s=='\r')) { s++; }
+    }
+
+    // triangle fan, with the winding flipped the same way as in parseOBJ
+    for(int k=2;k<face->size();k++)
+    {
+      const int corners[3] = { (*face)[0], (*face)[k], (*face)[k-1] };
+      glm::ivec3 triangle;
+      for(int j=0;j<3;j++)
+      {
+        if      (corners[j]>0) { triangle[j] = corners[j]-1; }
+        else if (corners[j]<0) { triangle[j] = int(chunk->vertices.size())+corners[j]; chunk->relativeCorners.push_back(chunk->triangles.size()*3+j); }
+        else                   { triangle[j] = 0; }
+      }
+      chunk->triangles.push_back(triangle);
+    }
+  }
+}
+
+static bool parseOBJParallel(const unsigned char* data,
+                             size_t size,
+                             std::vector<glm::vec3>* out_vertices,
+                             std::vector<glm::ivec3>* out_triangles)
+{
+  const char* text = (const char*)data;
+  const char* textEnd = text+size;
+
+  const size_t minChunkSize = 1<<20;
+  const int numChunks = std::max(std::min(int(size/minChunkSize),256),1);
+
+  std::vector<const char*> chunkBegins(numChunks+1);
+  chunkBegins[0] = text;
+  chunkBegins[numChunks] = textEnd;
+  for(int i=1;i<numChunks;i++)
+  {
+    const char* s = std::max(text+(size*i)/numChunks,chunkBegins[i-1]);
+    while (s<textEnd && *s!='\n' && *s!='\r') { s++; }
+    chunkBegins[i] = (s<textEnd) ? s+1 : textEnd;
+  }
+
+  std::vector<OBJChunk> chunks(numChunks);
+
+  parallelFor(numChunks,[&](int i)
+  {
+    std::vector<int> face;
+    const char* s = chunkBegins[i];
+    const char* chunkEnd = chunkBegins[i+1];
+    while (s<chunkEnd)
+    {
+      const char* lineEnd = s;
+      while (lineEnd<chunkEnd && *lineEnd!='\n' && *lineEnd!='\r') { lineEnd++; }
+      parseOBJLine(s,lineEnd,&chunks[i],&face);
+      s = lineEnd+1;
+    }
+  });
+
+  std::vector<int> vertexOffsets(numChunks+1,0);
+  std::vector<int> triangleOffsets(numChunks+1,0);
+  for(int i=0;i<numChunks;i++)
+  {
+    vertexOffsets[i+1] = vertexOffsets[i]+chunks[i].vertices.size();
+    triangleOffsets[i+1] = triangleOffsets[i]+chunks[i].triangles.size();
+  }
+
+  std::vector<glm::vec3>& vertices = *out_vertices;
+  std::vector<glm::ivec3>& triangles = *out_triangles;
+  vertices = std::vector<glm::vec3>(vertexOffsets[numChunks]);
+  triangles = std::vector<glm::ivec3>(triangleOffsets[numChunks]);
+
+  parallelFor(numChunks,[&](int i)
+  {
+    OBJChunk& chunk = chunks[i];
+    std::copy(chunk.vertices.begin(),chunk.vertices.end(),vertices.begin()+vertexOffsets[i]);
+    for(int j=0;j<chunk.relativeCorners.size();j++)
+    {
+      const int corner = chunk.relativeCorners[j];
+      chunk.triangles[corner/3][corner%3] += vertexOffsets[i];
+    }
+    std::copy(chunk.triangles.begin(),chunk.triangles.end(),triangles.begin()+triangleOffsets[i]);
+    chunk = OBJChunk();
+  });
+
+  return !triangles.empty();
+}
+
+// Centers and scales the mesh and computes smooth vertex normals. The work is
+// split into fixed-size blocks, so the result doesn't depend on the number of
+// threads. Vertex normals are gathered from a vertex-to-face adjacency (CSR)
+// instead of being scattered from faces, which lets every vertex be finished
+// independently, and the arithmetic runs on SoA arrays the compiler vectorizes.
+static void processMesh(std::vector<glm::vec3>* inout_vertices,
+                        const std::vector<glm::ivec3>& triangles,
+                        std::vector<glm::vec3>* out_normals)
+{
+  std::vector<glm::vec3>& vertices = *inout_vertices;
+  const int numVertices = vertices.size();
+  const int numTriangles = triangles.size();
+
+  const int blockSize = 4096;
+  const int numVertexBlocks = (numVertices+blockSize-1)/blockSize;
+  const int numTriangleBlocks = (numTriangles+blockSize-1)/blockSize;
+
   {
+    std::vector<glm::vec3> blockCentroids(numVertexBlocks);
+    parallelFor(numVertexBlocks,[&](int b)
+    {
+      glm::vec3 sum = glm::vec3(0,0,0);
+      for(int i=b*blockSize;i<std::min((b+1)*blockSize,numVertices);i++) { sum += vertices[i]; }
+      blockCentroids[b] = sum;
+    });
     glm::vec3 centroid = glm::vec3(0,0,0);
-    for (int i=0;i<vertices.size();i++) { centroid += vertices[i]; }
-    centroid = centroid / float(vertices.size());
+    for (int b=0;b<numVertexBlocks;b++) { centroid += blockCentroids[b]; }
+    centroid = centroid / float(numVertices);
 
+    std::vector<float> blockRadii(numVertexBlocks);
+    parallelFor(numVertexBlocks,[&](int b)
+    {
+      float sum = 0;
+      for(int i=b*blockSize;i<std::min((b+1)*blockSize,numVertices);i++) { sum += glm::length(vertices[i]-centroid); }
+      blockRadii[b] = sum;
+    });
     float radius = 0;
-    for (int i=0;i<vertices.size();i++) { radius += glm::length(vertices[i]-centroid); }
-    radius = radius / float(vertices.size());
+    for (int b=0;b<numVertexBlocks;b++) { radius += blockRadii[b]; }
+    radius = radius / float(numVertices);
 
-    for (int i=0;i<vertices.size();i++) { vertices[i] = (vertices[i]-centroid)/radius; }
+    parallelFor(numVertexBlocks,[&](int b)
+    {
+      for(int i=b*blockSize;i<std::min((b+1)*blockSize,numVertices);i++) { vertices[i] = (vertices[i]-centroid)/radius; }
+    });
   }
 
-  std::vector<glm::vec3> normals = std::vector<glm::vec3>(numVertices,glm::vec3(0,0,0));
+  // face normals
+  std::vector<float> faceNormalsX(numTriangles);
+  std::vector<float> faceNormalsY(numTriangles);
+  std::vector<float> faceNormalsZ(numTriangles);
+  parallelFor(numTriangleBlocks,[&](int b)
   {
-    std::vector<glm::vec3> faceNormals(triangles.size());
-    for(int i=0;i<triangles.size();i++)
+    const int begin = b*blockSize;
+    const int count = std::min(blockSize,numTriangles-begin);
+
+    std::vector<float> edges(6*blockSize);
+    float* e1x = &edges[0*blockSize]; float* e1y = &edges[1*blockSize]; float* e1z = &edges[2*blockSize];
+    float* e2x = &edges[3*blockSize]; float* e2y = &edges[4*blockSize]; float* e2z = &edges[5*blockSize];
+
+    for(int i=0;i<count;i++)
     {
-      const glm::ivec3 t = triangles[i];
-      faceNormals[i] = glm::normalize(glm::cross(vertices[t[1]]-vertices[t[0]],
-                                                 vertices[t[2]]-vertices[t[0]]));
+      const glm::ivec3 t = triangles[begin+i];
+      const glm::vec3 e1 = vertices[t[1]]-vertices[t[0]];
+      const glm::vec3 e2 = vertices[t[2]]-vertices[t[0]];
+      e1x[i] = e1.x; e1y[i] = e1.y; e1z[i] = e1.z;
+      e2x[i] = e2.x; e2y[i] = e2.y; e2z[i] = e2.z;
     }
 
-    std::vector<int> counts = std::vector<int>(vertices.size(),0);
-    for(int i=0;i<triangles.size();i++)
+    float* nx = &faceNormalsX[begin];
+    float* ny = &faceNormalsY[begin];
+    float* nz = &faceNormalsZ[begin];
+    for(int i=0;i<count;i++)
     {
-      for(int j=0;j<3;j++)
+      const float cx = e1y[i]*e2z[i]-e2y[i]*e1z[i];
+      const float cy = e1z[i]*e2x[i]-e2z[i]*e1x[i];
+      const float cz = e1x[i]*e2y[i]-e2x[i]*e1y[i];
+      const float s = 1.0f/std::sqrt(cx*cx+cy*cy+cz*cz);
+      nx[i] = cx*s; ny[i] = cy*s; nz[i] = cz*s;
+    }
+  });
+
+  // vertex-to-face adjacency in CSR form; the faces of each vertex are sorted
+  // so they are summed in the same order no matter how the fill was scheduled
+  std::vector<int> adjacencyOffsets(numVertices+1);
+  std::vector<int> adjacency(numTriangles*3);
+  {
+    std::vector<std::atomic<int> > cursors(numVertices);
+    parallelFor(numVertexBlocks,[&](int b)
+    {
+      for(int i=b*blockSize;i<std::min((b+1)*blockSize,numVertices);i++) { cursors[i].store(0,std::memory_order_relaxed); }
+    });
+    parallelFor(numTriangleBlocks,[&](int b)
+    {
+      for(int i=b*blockSize;i<std::min((b+1)*blockSize,numTriangles);i++)
+      {
+        for(int j=0;j<3;j++) { cursors[triangles[i][j]].fetch_add(1,std::memory_order_relaxed); }
+      }
+    });
+
+    adjacencyOffsets[0] = 0;
+    for(int i=0;i<numVertices;i++)
+    {
+      const int degree = cursors[i].load(std::memory_order_relaxed);
+      cursors[i].store(adjacencyOffsets[i],std::memory_order_relaxed);
+      adjacencyOffsets[i+1] = adjacencyOffsets[i]+degree;
+    }
+
+    parallelFor(numTriangleBlocks,[&](int b)
+    {
+      for(int i=b*blockSize;i<std::min((b+1)*blockSize,numTriangles);i++)
+      {
+        for(int j=0;j<3;j++) { adjacency[cursors[triangles[i][j]].fetch_add(1,std::memory_order_relaxed)] = i; }
+      }
+    });
+
+    parallelFor(numVertexBlocks,[&](int b)
+    {
+      for(int i=b*blockSize;i<std::min((b+1)*blockSize,numVertices);i++)
+      {
+        std::sort(adjacency.begin()+adjacencyOffsets[i],adjacency.begin()+adjacencyOffsets[i+1]);
+      }
+    });
+  }
+
+  // vertex normals
+  std::vector<glm::vec3>& normals = *out_normals;
+  normals = std::vector<glm::vec3>(numVertices);
+  parallelFor(numVertexBlocks,[&](int b)
+  {
+    const int begin = b*blockSize;
+    const int count = std::min(blockSize,numVertices-begin);
+
+    std::vector<float> sums(3*blockSize);
+    float* sx = &sums[0*blockSize]; float* sy = &sums[1*blockSize]; float* sz = &sums[2*blockSize];
+
+    for(int i=0;i<count;i++)
+    {
+      float x = 0; float y = 0; float z = 0;
+      for(int k=adjacencyOffsets[begin+i];k<adjacencyOffsets[begin+i+1];k++)
       {
-        normals[triangles[i][j]] += faceNormals[i];
-        counts[triangles[i][j]] += 1;
+        const int f = adjacency[k];
+        x += faceNormalsX[f]; y += faceNormalsY[f]; z += faceNormalsZ[f];
       }
+      const float degree = float(adjacencyOffsets[begin+i+1]-adjacencyOffsets[begin+i]);
+      sx[i] = x/degree; sy[i] = y/degree; sz[i] = z/degree;
     }
-    for(int i=0;i<normals.size();i++)
+
+    for(int i=0;i<count;i++)
     {
-      normals[i] = normalize(normals[i] / float(counts[i]));
+      const float s = 1.0f/std::sqrt(sx[i]*sx[i]+sy[i]*sy[i]+sz[i]*sz[i]);
+      sx[i] *= s; sy[i] *= s; sz[i] *= s;
     }
+
+    for(int i=0;i<count;i++) { normals[begin+i] = glm::vec3(sx[i],sy[i],sz[i]); }
+  });
+}
+
+static glm::vec3 decodeOctahedral(int sx,int sy)
+{
+  const glm::vec2 e = glm::vec2(float(sx)/32767.0f,float(sy)/32767.0f);
+  glm::vec3 n = glm::vec3(e.x,e.y,1.0f-std::fabs(e.x)-std::fabs(e.y));
+  if (n.z<0) { n = glm::vec3((1.0f-std::fabs(e.y))*(e.x>=0 ? 1.0f : -1.0f),(1.0f-std::fabs(e.x))*(e.y>=0 ? 1.0f : -1.0f),n.z); }
+  return glm::normalize(n);
+}
+
+static void encodeOctahedral(const glm::vec3& n,int16_t* out_encoded)
+{
+  const float l1 = std::fabs(n.x)+std::fabs(n.y)+std::fabs(n.z);
+  if (!(l1>0)) { out_encoded[0] = 0; out_encoded[1] = 0; return; }
+
+  glm::vec2 p = glm::vec2(n.x,n.y)/l1;
+  if (n.z<0) { p = glm::vec2((1.0f-std::fabs(p.y))*(p.x>=0 ? 1.0f : -1.0f),(1.0f-std::fabs(p.x))*(p.y>=0 ? 1.0f : -1.0f)); }
+
+  // of the four neighboring grid points keep the one that decodes closest to n
+  const int x0 = int(std::floor(p.x*32767.0f));
+  const int y0 = int(std::floor(p.y*32767.0f));
+  float bestDot = -2.0f;
+  for(int y=y0;y<=y0+1;y++)
+  for(int x=x0;x<=x0+1;x++)
+  {
+    const int sx = std::min(std::max(x,-32767),32767);
+    const int sy = std::min(std::max(y,-32767),32767);
+    const float d = glm::dot(decodeOctahedral(sx,sy),n);
+    if (d>bestDot) { bestDot = d; out_encoded[0] = sx; out_encoded[1] = sy; }
+  }
+}
+
+static void quantizeMesh(const std::vector<glm::vec3>& vertices,
+                         const std::vector<glm::vec3>& normals,
+                         std::vector<PackedVertex>* out_packedVertices,
+                         glm::vec3* out_positionMin,
+                         glm::vec3* out_positionExtent)
+{
+  glm::vec3 positionMin = vertices.empty() ? glm::vec3(0,0,0) : vertices[0];
+  glm::vec3 positionMax = positionMin;
+  for(int i=0;i<vertices.size();i++)
+  {
+    positionMin = glm::min(positionMin,vertices[i]);
+    positionMax = glm::max(positionMax,vertices[i]);
   }
+  const glm::vec3 positionExtent = positionMax-positionMin;
+  const glm::vec3 positionScale = glm::vec3(positionExtent.x>0 ? 65535.0f/positionExtent.x : 0.0f,
+                                            positionExtent.y>0 ? 65535.0f/positionExtent.y : 0.0f,
+                                            positionExtent.z>0 ? 65535.0f/positionExtent.z : 0.0f);
 
-  std::vector<glm::vec3> vertexBuffer(triangles.size()*3);
-  std::vector<glm::vec3> normalBuffer(triangles.size()*3);
+  std::vector<PackedVertex>& packedVertices = *out_packedVertices;
+  packedVertices = std::vector<PackedVertex>(vertices.size());
 
-  for(int i=0;i<triangles.size();i++)
+  const int blockSize = 4096;
+  parallelFor((vertices.size()+blockSize-1)/blockSize,[&](int b)
   {
-    for(int j=0;j<3;j++)
+    for(int i=b*blockSize;i<std::min(int(vertices.size()),(b+1)*blockSize);i++)
     {
-      vertexBuffer[i*3+j] = vertices[triangles[i][j]];
-      normalBuffer[i*3+j] = normals[triangles[i][j]];;
+      const glm::vec3 q = (vertices[i]-positionMin)*positionScale+glm::vec3(0.5f,0.5f,0.5f);
+      packedVertices[i].position[0] = uint16_t(std::min(q.x,65535.0f));
+      packedVertices[i].position[1] = uint16_t(std::min(q.y,65535.0f));
+      packedVertices[i].position[2] = uint16_t(std::min(q.z,65535.0f));
+      packedVertices[i].position[3] = 0;
+      encodeOctahedral(normals[i],packedVertices[i].normal);
     }
+  });
+
+  *out_positionMin = positionMin;
+  *out_positionExtent = positionExtent;
+}
+
+static void writeMeshCache(const std::string& cacheFileName,
+                           uint64_t sourceSize,
+                           uint64_t sourceHash,
+                           const glm::vec3& positionMin,
+                           const glm::vec3& positionExtent,
+                           const std::vector<PackedVertex>& vertices,
+                           const std::vector<glm::ivec3>& triangles)
+{
+  MeshCacheHeader header;
+  memcpy(header.magic,meshCacheMagic,sizeof(header.magic));
+  header.version = meshCacheVersion;
+  header.numVertices = vertices.size();
+  header.numIndices = triangles.size()*3;
+  header.reserved = 0;
+  header.sourceSize = sourceSize;
+  header.sourceHash = sourceHash;
+  for(int i=0;i<3;i++)
+  {
+    header.positionMin[i] = positionMin[i];
+    header.positionExtent[i] = positionExtent[i];
   }
 
+  FILE* f = fopen(cacheFileName.c_str(),"wb");
+  if (!f) { return; }
+  fwrite(&header,sizeof(header),1,f);
+  fwrite(vertices.data(),sizeof(PackedVertex),vertices.size(),f);
+  fwrite(triangles.data(),sizeof(glm::ivec3),triangles.size(),f);
+  fclose(f);
+}
+
+static GLuint createVertexArray(GLuint positionLocation,
+                                GLuint normalLocation,
+                                int numVertices,
+                                const void* vertexData,
+                                int numIndices,
+                                const void* indexData)
+{
   GLuint vbo;
   glGenBuffers(1,&vbo);
   glBindBuffer(GL_ARRAY_BUFFER,vbo);
-  glBufferData(GL_ARRAY_BUFFER,sizeof(glm::vec3)*vertexBuffer.size(),vertexBuffer.data(),GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER,0);
-
-  GLuint nbo;
-  glGenBuffers(1,&nbo);
-  glBindBuffer(GL_ARRAY_BUFFER,nbo);
-  glBufferData(GL_ARRAY_BUFFER,sizeof(glm::vec3)*normalBuffer.size(),normalBuffer.data(),GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER,sizeof(PackedVertex)*numVertices,vertexData,GL_STATIC_DRAW);
   glBindBuffer(GL_ARRAY_BUFFER,0);
 
   GLuint vao;
   glGenVertexArrays(1,&vao);
   glBindVertexArray(vao);
 
+  GLuint ibo;
+  glGenBuffers(1,&ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(uint32_t)*numIndices,indexData,GL_STATIC_DRAW);
+
   glBindBuffer(GL_ARRAY_BUFFER,vbo);
-  glVertexAttribPointer(positionLocation,3,GL_FLOAT,GL_FALSE,0,0);
+  glVertexAttribPointer(positionLocation,3,GL_UNSIGNED_SHORT,GL_TRUE,sizeof(PackedVertex),(const void*)offsetof(PackedVertex,position));
   glEnableVertexAttribArray(positionLocation);
-
-  glBindBuffer(GL_ARRAY_BUFFER,nbo);
-  glVertexAttribPointer(normalLocation,3,GL_FLOAT,GL_FALSE,0,0);
+  glVertexAttribPointer(normalLocation,2,GL_SHORT,GL_TRUE,sizeof(PackedVertex),(const void*)offsetof(PackedVertex,normal));
   glEnableVertexAttribArray(normalLocation);
 
-  *numModelVerts = vertexBuffer.size();
-  
   return vao;
 }
 
+static GLuint createVertexArrayFromOBJ(const std::string& objFileName,
+                                       GLuint positionLocation,
+                                       GLuint normalLocation,
+                                       int* numModelIndices,
+                                       glm::vec3* positionMin,
+                                       glm::vec3* positionExtent)
+{
+  MappedFile objFile;
+  if (!mapFile(objFileName.c_str(),&objFile)) { return 0; }
+  const uint64_t sourceSize = objFile.size;
+  const uint64_t sourceHash = hashBytes(objFile.data,objFile.size);
+
+  const std::string cacheFileName = objFileName+".cache";
+
+  MappedFile cacheFile;
+  if (mapFile(cacheFileName.c_str(),&cacheFile))
+  {
+    MeshCacheHeader header;
+    bool valid = false;
+    if (cacheFile.size>=sizeof(header))
+    {
+      memcpy(&header,cacheFile.data,sizeof(header));
+      valid = (memcmp(header.magic,meshCacheMagic,sizeof(header.magic))==0 &&
+               header.version==meshCacheVersion &&
+               header.sourceSize==sourceSize &&
+               header.sourceHash==sourceHash &&
+               cacheFile.size==sizeof(header)+
+                               sizeof(PackedVertex)*size_t(header.numVertices)+
+                               sizeof(uint32_t)*size_t(header.numIndices));
+    }
+    if (valid)
+    {
+      const unsigned char* vertexData = cacheFile.data+sizeof(header);
+      const unsigned char* indexData  = vertexData+sizeof(PackedVertex)*header.numVertices;
+
+      const GLuint vao = createVertexArray(positionLocation,normalLocation,
+                                           header.numVertices,vertexData,
+                                           header.numIndices,indexData);
+      *numModelIndices = header.numIndices;
+      *positionMin = glm::vec3(header.positionMin[0],header.positionMin[1],header.positionMin[2]);
+      *positionExtent = glm::vec3(header.positionExtent[0],header.positionExtent[1],header.positionExtent[2]);
+      unmapFile(&cacheFile);
+      unmapFile(&objFile);
+      return vao;
+    }
+    unmapFile(&cacheFile);
+  }
+
+  std::vector<glm::vec3> vertices;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::ivec3> triangles;
+
+#ifdef __EMSCRIPTEN__
+  const bool parsed = parseOBJ(objFileName,&vertices,&triangles);
+#else
+  const bool parsed = parseOBJParallel(objFile.data,objFile.size,&vertices,&triangles);
+#endif
+  unmapFile(&objFile);
+
+  if (!parsed) { return 0; }
+
+  processMesh(&vertices,triangles,&normals);
+
+  std::vector<PackedVertex> packedVertices;
+  quantizeMesh(vertices,normals,&packedVertices,positionMin,positionExtent);
+
+  writeMeshCache(cacheFileName,sourceSize,sourceHash,*positionMin,*positionExtent,packedVertices,triangles);
+
+  *numModelIndices = triangles.size()*3;
+
+  return createVertexArray(positionLocation,normalLocation,
+                           packedVertices.size(),packedVertices.data(),
+                           triangles.size()*3,triangles.data());
+}
+
 static float clamp(float x,float xmin,float xmax)
 {
   return std::min(std::max(x,xmin),xmax);
@@ -340,6 +1058,8 @@ void keyCallback(GLFWwindow* window,int key,int scancode,int action,int mods)
   if (key==GLFW_KEY_DOWN   && (action==GLFW_PRESS||action==GLFW_REPEAT)) { if (threshold>=4)  { threshold -= 4;   } }
   if (key==GLFW_KEY_RIGHT  && (action==GLFW_PRESS||action==GLFW_REPEAT)) { if (blendRadius<8) { blendRadius += 1; } }
   if (key==GLFW_KEY_LEFT   && (action==GLFW_PRESS||action==GLFW_REPEAT)) { if (blendRadius>0) { blendRadius -= 1; } }
+  if (key==GLFW_KEY_S      && action==GLFW_PRESS) { statsRequested = true; }
+  if (key==GLFW_KEY_P      && action==GLFW_PRESS) { if (!presets.empty()) { applyPreset((currentPreset+1)%presets.size()); } }
   if (key==GLFW_KEY_ESCAPE && (action==GLFW_PRESS||action==GLFW_REPEAT)) { done = true; }
 }
   
@@ -581,6 +1301,22 @@ static bool iconClicked(const glm::mat4& projMatrix,int x0,int y0,int x1,int y1,
   return clicked;
 }
 
+#ifndef __EMSCRIPTEN__
+static void printStats()
+{
+  StyleblitStats stats;
+  if (!styleblitStats(&stats) || stats.numPixels==0) { return; }
+
+  const float pixels = stats.numPixels;
+  printf("threshold %.0f: %d pixels, %.1f%% kept, %.1f%% fallback\n",threshold,stats.numPixels,100.0f*stats.numKept/pixels,100.0f*stats.numFallbacks/pixels);
+  printf("accepted at level");
+  for(int i=6;i>=0;i--) { printf(" %d:%.1f%%",i,100.0f*stats.levels[i]/pixels); }
+  printf("\n%d chunks, %.1f pixels on average, by size",stats.numChunks,pixels/std::max(stats.numChunks,1));
+  for(int i=0;i<16;i++) { if (stats.chunkSizes[i]>0) { printf(" %d+:%d",1<<i,stats.chunkSizes[i]); } }
+  printf("\n");
+}
+#endif
+
 static void mainloop()
 {
   for(int button=0;button<3;button++)
@@ -614,15 +1350,28 @@ static void mainloop()
 
   if (glfwWindowShouldClose(window)) { done = true; }
 
-  if (targetWidth!=windowWidth ||
-      targetHeight!=windowHeight)
+  // below scale 1 the target is stylized at a lower resolution and stretched
+  // over the window
+  if (renderScale!=currentStyleScale) { loadStyleTextures(); }
+
+  const int scaledWidth = std::max(int(windowWidth*renderScale),1);
+  const int scaledHeight = std::max(int(windowHeight*renderScale),1);
+
+  if (targetWidth!=scaledWidth ||
+      targetHeight!=scaledHeight)
   {
-    targetWidth = windowWidth;
-    targetHeight = windowHeight;
+    targetWidth = scaledWidth;
+    targetHeight = scaledHeight;
+
+    glDeleteTextures(1,&texOutput);
+    texOutput = createTexture2D(GL_RGBA,targetWidth,targetHeight,0,GL_LINEAR,GL_CLAMP_TO_EDGE);
 
     glDeleteTextures(1,&texTargetNormals);
     texTargetNormals = createTexture2D(GL_RGBA,targetWidth,targetHeight,0,GL_NEAREST,GL_CLAMP_TO_EDGE);
 
+    glDeleteTextures(1,&texTargetMotion);
+    texTargetMotion = createTexture2D(GL_RGBA,targetWidth,targetHeight,0,GL_NEAREST,GL_CLAMP_TO_EDGE);
+
     glBindRenderbuffer(GL_RENDERBUFFER,depthBuffer);
     glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH_COMPONENT16,targetWidth,targetHeight);
   }
@@ -655,9 +1404,27 @@ static void mainloop()
 
   glUniformMatrix4fv(glGetUniformLocation(progDrawNormals,"projviewMatrix"),1,GL_FALSE,glm::value_ptr(projViewMatrix));
   glUniformMatrix4fv(glGetUniformLocation(progDrawNormals,"normalMatrix"),1,GL_FALSE,glm::value_ptr(normalMatrix));
+  glUniform3fv(glGetUniformLocation(progDrawNormals,"positionMin"),1,glm::value_ptr(modelPositionMin));
+  glUniform3fv(glGetUniformLocation(progDrawNormals,"positionExtent"),1,glm::value_ptr(modelPositionExtent));
 
   glBindVertexArray(vaoModel);
-  glDrawArrays(GL_TRIANGLES,0,numModelVerts);
+  glDrawElements(GL_TRIANGLES,numModelIndices,GL_UNSIGNED_INT,0);
+
+  bindFBO(fbo,texTargetMotion,depthBuffer);
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  glUseProgram(progDrawMotion);
+
+  glUniformMatrix4fv(glGetUniformLocation(progDrawMotion,"projviewMatrix"),1,GL_FALSE,glm::value_ptr(projViewMatrix));
+  glUniformMatrix4fv(glGetUniformLocation(progDrawMotion,"previousProjviewMatrix"),1,GL_FALSE,glm::value_ptr(previousProjViewMatrix));
+  glUniform3fv(glGetUniformLocation(progDrawMotion,"positionMin"),1,glm::value_ptr(modelPositionMin));
+  glUniform3fv(glGetUniformLocation(progDrawMotion,"positionExtent"),1,glm::value_ptr(modelPositionExtent));
+  glUniform2f(glGetUniformLocation(progDrawMotion,"targetSize"),targetWidth,targetHeight);
+
+  glDrawElements(GL_TRIANGLES,numModelIndices,GL_UNSIGNED_INT,0);
+
+  previousProjViewMatrix = projViewMatrix;
 
   glBindVertexArray(0);
   glBindBuffer(GL_ARRAY_BUFFER,0);
@@ -665,7 +1432,16 @@ static void mainloop()
   glDisable(GL_DEPTH_TEST);
   glDisable(GL_CULL_FACE);
 
-  glBindFramebuffer(GL_FRAMEBUFFER,0);
+  const bool scaled = (targetWidth!=windowWidth || targetHeight!=windowHeight);
+  if (scaled)
+  {
+    bindFBO(fbo,texOutput,depthBuffer);
+    glClear(GL_DEPTH_BUFFER_BIT);
+  }
+  else
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+  }
 
   styleblit(targetWidth,
             targetHeight,
@@ -676,7 +1452,23 @@ static void mainloop()
             texSourceStyle,
             threshold,
             blendRadius,
-            jitterThisFrame);
+            jitterThisFrame,
+            STYLEBLIT_TEMPORAL | STYLEBLIT_COARSEST_LEVEL(coarsestLevel) |
+            (gridSeeds ? STYLEBLIT_NO_JITTER : 0) | (statsRequested ? STYLEBLIT_LEVEL_STATS : 0),
+            texTargetMotion);
+
+  if (scaled)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+    glViewport(0,0,windowWidth,windowHeight);
+    glDisable(GL_DEPTH_TEST);
+    drawRectTex(glm::ortho(0.0f,float(windowWidth),float(windowHeight),0.0f,-1.0f,+1.0f),0,0,windowWidth,windowHeight,texOutput);
+  }
+
+#ifndef __EMSCRIPTEN__
+  if (statsRequested) { printStats(); }
+#endif
+  statsRequested = false;
 
   {
     glDisable(GL_DEPTH_TEST);
@@ -689,13 +1481,7 @@ static void mainloop()
       const int y = spacing/3;
       if (iconClicked(projMatrix,x+spacing/2,y+spacing/2,x+iconSize-spacing,y+iconSize-spacing,texStyleIcons[i]))
       {
-        glDeleteTextures(1,&texSourceStyle);
-        glDeleteTextures(1,&texSourceNormals);
-
-        sourceSize = (i==0||i==1||i==2||i==5||i==9) ? windowHeight/4 : windowHeight/3;
-
-        texSourceStyle   = loadTexture("data/"+styles[i],GL_RGB,sourceSize,GL_NEAREST);
-        texSourceNormals = loadTexture("data/normals.png",GL_RGB,sourceSize,GL_NEAREST);
+        selectStyle(i);
       }
     }
   }
@@ -706,18 +1492,199 @@ static void mainloop()
   glfwPollEvents();
 }
 
+#ifndef __EMSCRIPTEN__
+// styleblit --sequence <guide pattern> <output> <first frame> <frame count> [style] [mask pattern]
+static int runSequence(int argc,char* args[])
+{
+  if (argc<6) { fprintf(stderr,"usage: %s --sequence <guide pattern> <output> <first frame> <frame count> [style] [mask pattern]\n",args[0]); return 1; }
+
+  SequenceOptions options;
+  options.guidePattern = args[2];
+  options.firstFrame = atoi(args[4]);
+  options.numFrames = atoi(args[5]);
+  options.maskPattern = (argc>7) ? args[7] : 0;
+  options.jitterPeriod = 2;
+  options.ringSize = 4;
+
+  int width,height;
+  const std::string firstFileName = frameFileName(options.guidePattern,options.firstFrame);
+  if (!stbi_info(firstFileName.c_str(),&width,&height,NULL)) { fprintf(stderr,"failed to load %s\n",firstFileName.c_str()); return 1; }
+
+  const std::string style = (argc>6) ? args[6] : styles[0];
+  const int size = styleSourceSize(height/4);
+  const GLuint texStyle = loadTexture("data/"+style,GL_RGB,size,GL_NEAREST);
+  const GLuint texNormals = loadTexture("data/normals.png",GL_RGB,size,GL_NEAREST);
+
+  FrameSink* sink = createFrameSink(args[3],24);
+  const bool ok = stylizeSequence(options,sink,size,size,texNormals,texStyle,threshold,blendRadius);
+  delete sink;
+  return ok ? 0 : 1;
+}
+
+// styleblit --playback <stream.nnf> <output> [style]
+static int runPlayback(int argc,char* args[])
+{
+  if (argc<4) { fprintf(stderr,"usage: %s --playback <stream.nnf> <output> [style]\n",args[0]); return 1; }
+
+  FILE* stream = fopen(args[2],"rb");
+  NNFStreamHeader header;
+  if (!stream || !readNNFStreamHeader(stream,&header)) { fprintf(stderr,"failed to load %s, expected an NNF stream\n",args[2]); if (stream) { fclose(stream); } return 1; }
+
+  // the NNF points into the source at the size it was recorded with
+  const std::string style = (argc>4) ? args[4] : styles[0];
+  const GLuint texStyle = loadTexture("data/"+style,GL_RGB,header.sourceWidth,GL_NEAREST);
+
+  FrameSink* sink = createFrameSink(args[3],24);
+  const bool ok = !sink->wantsNNF() && blendSequence(stream,header,sink,texStyle,blendRadius,4);
+  delete sink;
+  fclose(stream);
+  return ok ? 0 : 1;
+}
+
+// styleblit --tiled <guide.ppm|pam> <output.ppm> [style] [tile size]
+static int runTiled(int argc,char* args[])
+{
+  if (argc<4) { fprintf(stderr,"usage: %s --tiled <guide.ppm|pam> <output.ppm> [style] [tile size]\n",args[0]); return 1; }
+
+  GuideImage guide;
+  if (!openGuideImage(args[2],&guide)) { fprintf(stderr,"failed to load %s, expected a binary PPM or PAM\n",args[2]); return 1; }
+  fclose(guide.file);
+
+  GLint maxTextureSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE,&maxTextureSize);
+
+  const std::string style = (argc>4) ? args[4] : styles[0];
+  const int tileSize = (argc>5) ? atoi(args[5]) : 2048;
+  const int size = styleSourceSize(std::min(guide.height/4,int(maxTextureSize)));
+  const GLuint texStyle = loadTexture("data/"+style,GL_RGB,size,GL_NEAREST);
+  const GLuint texNormals = loadTexture("data/normals.png",GL_RGB,size,GL_NEAREST);
+
+  return stylizeTiled(args[2],args[3],tileSize,size,size,texNormals,texStyle,threshold,blendRadius) ? 0 : 1;
+}
+
+// styleblit --tune <guide pattern> <first frame> <frame count> [style] [presets]
+static int runTune(int argc,char* args[])
+{
+  if (argc<5) { fprintf(stderr,"usage: %s --tune <guide pattern> <first frame> <frame count> [style] [presets]\n",args[0]); return 1; }
+
+  SequenceOptions options;
+  options.guidePattern = args[2];
+  options.firstFrame = atoi(args[3]);
+  options.numFrames = atoi(args[4]);
+  options.maskPattern = 0;
+  options.jitterPeriod = 0;
+  options.ringSize = 0;
+
+  const std::string style = (argc>5) ? args[5] : styles[0];
+  const std::string presetsFileName = (argc>6) ? args[6] : stylePresetsFileName(style);
+
+  std::vector<GLuint> loadedTextures;
+  const auto loadSource = [&](int targetHeight,GLuint* texStyle,GLuint* texNormals,int* size) -> bool
+  {
+    *size = styleSourceSize(style,targetHeight);
+    *texStyle = loadTexture("data/"+style,GL_RGB,*size,GL_NEAREST);
+    *texNormals = loadTexture("data/normals.png",GL_RGB,*size,GL_NEAREST);
+    loadedTextures.push_back(*texStyle);
+    loadedTextures.push_back(*texNormals);
+    return *texStyle!=0 && *texNormals!=0;
+  };
+
+  std::vector<Preset> frontier;
+  int defaultPreset = 0;
+  const bool ok = tunePresets(options,loadSource,&frontier,&defaultPreset);
+  glDeleteTextures(loadedTextures.size(),loadedTextures.data());
+  if (!ok) { return 1; }
+
+  const std::string comment = "styleblit presets of "+style+", tuned on "+options.guidePattern;
+  if (!savePresets(presetsFileName.c_str(),frontier,defaultPreset,comment.c_str())) { fprintf(stderr,"failed to write %s\n",presetsFileName.c_str()); return 1; }
+  printf("%d presets written to %s\n",int(frontier.size()),presetsFileName.c_str());
+  return 0;
+}
+#endif
+
+#if !defined(__EMSCRIPTEN__) && !defined(_WIN32)
+// styleblit --daemon <socket path>
+static int runStyleDaemon(int argc,char* args[])
+{
+  if (argc<3) { fprintf(stderr,"usage: %s --daemon <socket path>\n",args[0]); return 1; }
+
+  struct LoadedStyle
+  {
+    std::string name;
+    int size;
+    GLuint texStyle;
+  };
+  std::vector<LoadedStyle> loadedStyles;
+  std::vector<std::pair<int,GLuint> > loadedNormals;
+
+  const auto loadStyle = [&](const char* style,int requestedSize,GLuint* texStyle,GLuint* texNormals,int* size) -> bool
+  {
+    if (strchr(style,'/') || strchr(style,'\\')) { return false; }
+    *size = styleSourceSize(requestedSize);
+
+    *texStyle = 0;
+    for(int i=0;i<loadedStyles.size();i++)
+    {
+      if (loadedStyles[i].name==style && loadedStyles[i].size==*size) { *texStyle = loadedStyles[i].texStyle; }
+    }
+    if (*texStyle==0)
+    {
+      FILE* f = fopen(("data/"+std::string(style)).c_str(),"rb");
+      if (!f && !findPackedImage(assetPack,("data/"+std::string(style)).c_str(),*size,*size,3)) { return false; }
+      if (f) { fclose(f); }
+      LoadedStyle loadedStyle;
+      loadedStyle.name = style;
+      loadedStyle.size = *size;
+      loadedStyle.texStyle = loadTexture("data/"+loadedStyle.name,GL_RGB,*size,GL_NEAREST);
+      loadedStyles.push_back(loadedStyle);
+      *texStyle = loadedStyle.texStyle;
+    }
+
+    *texNormals = 0;
+    for(int i=0;i<loadedNormals.size();i++)
+    {
+      if (loadedNormals[i].first==*size) { *texNormals = loadedNormals[i].second; }
+    }
+    if (*texNormals==0)
+    {
+      *texNormals = loadTexture("data/normals.png",GL_RGB,*size,GL_NEAREST);
+      loadedNormals.push_back(std::make_pair(*size,*texNormals));
+    }
+
+    return true;
+  };
+
+  return runDaemon(args[2],loadStyle) ? 0 : 1;
+}
+#endif
+
 int main(int argc,char* args[])
 {
-  printf("Controls                                \n");
-  printf("========================================\n");
-  printf("Left button  - orbit camera             \n");
-  printf("Right button - move camera              \n");
-  printf("Mouse wheel  - zoom in/out              \n");
-  printf("Key J        - toggle jitter            \n");
-  printf("Up arrow     - increase treshold        \n");
-  printf("Down arrow   - decrease treshold        \n");
-  printf("Left arrow   - decrease blending radius \n");
-  printf("Right arrow  - increase blending radius \n");
+  const bool sequenceMode = (argc>1 && strcmp(args[1],"--sequence")==0);
+  const bool tiledMode = (argc>1 && strcmp(args[1],"--tiled")==0);
+  const bool daemonMode = (argc>1 && strcmp(args[1],"--daemon")==0);
+  const bool playbackMode = (argc>1 && strcmp(args[1],"--playback")==0);
+  const bool tuneMode = (argc>1 && strcmp(args[1],"--tune")==0);
+  const bool batchMode = sequenceMode || tiledMode || daemonMode || playbackMode || tuneMode;
+
+  // in sequence mode stdout may carry the output stream
+  if (!batchMode)
+  {
+    printf("Controls                                \n");
+    printf("========================================\n");
+    printf("Left button  - orbit camera             \n");
+    printf("Right button - move camera              \n");
+    printf("Mouse wheel  - zoom in/out              \n");
+    printf("Key J        - toggle jitter            \n");
+    printf("Up arrow     - increase treshold        \n");
+    printf("Down arrow   - decrease treshold        \n");
+    printf("Left arrow   - decrease blending radius \n");
+    printf("Right arrow  - increase blending radius \n");
+    printf("Key P        - next preset of the style \n");
+#ifndef __EMSCRIPTEN__
+    printf("Key S        - print match statistics   \n");
+#endif
+  }
  
   styles.push_back("0.png");
   styles.push_back("01c.png");
@@ -741,6 +1708,8 @@ int main(int argc,char* args[])
   glfwWindowHint(GLFW_OPENGL_PROFILE,GLFW_OPENGL_CORE_PROFILE);
 #endif
 
+  if (batchMode) { glfwWindowHint(GLFW_VISIBLE,GLFW_FALSE); }
+
   window = glfwCreateWindow(640,700,"StyleBlit",NULL,NULL);
   
   if (!window) { glfwTerminate(); return -1; }
@@ -755,6 +1724,26 @@ int main(int argc,char* args[])
 #ifndef __APPLE__
   glewInit();
 #endif
+
+  // the asset pack (written by tools/packstyles) spares decoding and resizing
+  // the PNGs; without it they are loaded from data/
+  mapFile("styles.pack",&assetPack);
+
+#ifndef __EMSCRIPTEN__
+  if (batchMode)
+  {
+    int result = 1;
+    if      (sequenceMode) { result = runSequence(argc,args); }
+    else if (tiledMode)    { result = runTiled(argc,args); }
+    else if (playbackMode) { result = runPlayback(argc,args); }
+    else if (tuneMode)     { result = runTune(argc,args); }
+#ifndef _WIN32
+    else if (daemonMode)   { result = runStyleDaemon(argc,args); }
+#endif
+    glfwTerminate();
+    return result;
+  }
+#endif
   
   glGenFramebuffers(1,&fbo);
   glGenRenderbuffers(1,&depthBuffer);
@@ -767,16 +1756,24 @@ int main(int argc,char* args[])
 
 
   progDrawNormals = createProgram("data/normals.vert","data/normals.frag");
+  progDrawMotion = createProgram("data/motion.vert","data/motion.frag");
 
   vaoModel = createVertexArrayFromOBJ("data/golem.obj",
                                       glGetAttribLocation(progDrawNormals,"position"),
                                       glGetAttribLocation(progDrawNormals,"normal"),
-                                      &numModelVerts);
+                                      &numModelIndices,
+                                      &modelPositionMin,
+                                      &modelPositionExtent);
 
-  sourceSize = windowHeight/4;
+  if (!assetPack.data)
+  {
+    std::vector<std::string> imageFileNames;
+    for(int i=0;i<styles.size();i++) { imageFileNames.push_back("data/"+styles[i]); }
+    imageFileNames.push_back("data/normals.png");
+    preloadNativeImages(imageFileNames);
+  }
 
-  texSourceStyle = loadTexture("data/"+styles[0],GL_RGB,sourceSize,GL_NEAREST);
-  texSourceNormals = loadTexture("data/normals.png",GL_RGB,sourceSize,GL_NEAREST);
+  selectStyle(0);
 
   for(int i=0;i<styles.size();i++)
   {
@@ -0,0 +1,99 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef MMAPFILE_H_
+#define MMAPFILE_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+
+#if defined(_WIN32)
+  #ifndef NOMINMAX
+  #define NOMINMAX
+  #endif
+  #ifndef WIN32_LEAN_AND_MEAN
+  #define WIN32_LEAN_AND_MEAN
+  #endif
+  #include <windows.h>
+#elif !defined(__EMSCRIPTEN__)
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+// Read-only view of a whole file. On desktop the file is memory-mapped,
+// on the web (where there is no real file system) it is read into memory.
+struct MappedFile
+{
+  const unsigned char* data;
+  size_t size;
+#if defined(_WIN32)
+  HANDLE file;
+  HANDLE mapping;
+#endif
+};
+
+static inline bool mapFile(const char* fileName,MappedFile* mappedFile)
+{
+  mappedFile->data = 0;
+  mappedFile->size = 0;
+
+#if defined(_WIN32)
+  mappedFile->file = CreateFileA(fileName,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+  if (mappedFile->file==INVALID_HANDLE_VALUE) { return false; }
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(mappedFile->file,&fileSize) || fileSize.QuadPart==0) { CloseHandle(mappedFile->file); return false; }
+  mappedFile->mapping = CreateFileMappingA(mappedFile->file,NULL,PAGE_READONLY,0,0,NULL);
+  if (!mappedFile->mapping) { CloseHandle(mappedFile->file); return false; }
+  mappedFile->data = (const unsigned char*)MapViewOfFile(mappedFile->mapping,FILE_MAP_READ,0,0,0);
+  if (!mappedFile->data) { CloseHandle(mappedFile->mapping); CloseHandle(mappedFile->file); return false; }
+  mappedFile->size = size_t(fileSize.QuadPart);
+#elif defined(__EMSCRIPTEN__)
+  FILE* f = fopen(fileName,"rb");
+  if (!f) { return false; }
+  fseek(f,0,SEEK_END);
+  const long int fileSize = ftell(f);
+  rewind(f);
+  if (fileSize<=0) { fclose(f); return false; }
+  unsigned char* data = (unsigned char*)malloc(fileSize);
+  if (fread(data,1,fileSize,f)!=size_t(fileSize)) { free(data); fclose(f); return false; }
+  fclose(f);
+  mappedFile->data = data;
+  mappedFile->size = fileSize;
+#else
+  const int fd = open(fileName,O_RDONLY);
+  if (fd<0) { return false; }
+  struct stat st;
+  if (fstat(fd,&st)!=0 || st.st_size==0) { close(fd); return false; }
+  void* data = mmap(0,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if (data==MAP_FAILED) { return false; }
+  mappedFile->data = (const unsigned char*)data;
+  mappedFile->size = st.st_size;
+#endif
+
+  return true;
+}
+
+static inline void unmapFile(MappedFile* mappedFile)
+{
+  if (!mappedFile->data) { return; }
+
+#if defined(_WIN32)
+  UnmapViewOfFile(mappedFile->data);
+  CloseHandle(mappedFile->mapping);
+  CloseHandle(mappedFile->file);
+#elif defined(__EMSCRIPTEN__)
+  free((void*)mappedFile->data);
+#else
+  munmap((void*)mappedFile->data,mappedFile->size);
+#endif
+
+  mappedFile->data = 0;
+  mappedFile->size = 0;
+}
+
+#endif
@@ -0,0 +1,345 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef NNFCODEC_H_
+#define NNFCODEC_H_
+
+// Compact storage of the NNFs of a sequence (see styleblitNNF), so a result
+// can be kept and later re-blended with any exemplar instead of being stored
+// as pixels. The NNF is piecewise a translation: all pixels of a chunk point
+// to the source with the same offset (source minus target position). A frame
+// is a table of the distinct offsets its literals use followed by every row
+// as runs of
+//
+//   0  the same entries as in the previous frame
+//   1  the same entries as in the row below
+//   2  one entry: 0 for masked out, k for the k-th offset of the table
+//
+// Runs are varints of (length<<2)|type, an entry follows a run of type 2.
+// Keyframes don't use runs of type 0, so playback can start at them.
+//
+// Stream layout (little endian):
+//   header  "NNF1", width, height, source width, source height (int32)
+//   frame   payload size (uint32), frame number (int32), payload:
+//           flags byte (1 = keyframe), table size, the offsets as zigzag
+//           varint deltas from the entry before, then the runs of all rows
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+static const uint32_t nnfStreamMagic = 0x31464e4e; // "NNF1"
+
+struct NNFStreamHeader
+{
+  int width;
+  int height;
+  int sourceWidth;
+  int sourceHeight;
+};
+
+// An entry is the offset as two 32-bit numbers, masked out pixels get dx
+// INT32_MIN, which no real offset reaches.
+static const uint64_t nnfMaskedEntry = uint64_t(0x80000000u)<<32;
+
+static inline uint64_t nnfEntry(int dx,int dy) { return (uint64_t(uint32_t(dx))<<32)|uint32_t(dy); }
+static inline int nnfEntryX(uint64_t entry)    { return int(uint32_t(entry>>32)); }
+static inline int nnfEntryY(uint64_t entry)    { return int(uint32_t(entry)); }
+
+static void putUint32(std::vector<unsigned char>* out,uint32_t value)
+{
+  for(int i=0;i<4;i++) { out->push_back((value>>(i*8))&0xff); }
+}
+
+static uint32_t getUint32(const unsigned char* bytes)
+{
+  return uint32_t(bytes[0])|(uint32_t(bytes[1])<<8)|(uint32_t(bytes[2])<<16)|(uint32_t(bytes[3])<<24);
+}
+
+static void putVarint(std::vector<unsigned char>* out,uint32_t value)
+{
+  while (value>=0x80) { out->push_back((value&0x7f)|0x80); value >>= 7; }
+  out->push_back(value);
+}
+
+static bool getVarint(const unsigned char** bytes,const unsigned char* end,uint32_t* value)
+{
+  *value = 0;
+  for(int shift=0;shift<35;shift+=7)
+  {
+    if (*bytes==end) { return false; }
+    const unsigned char byte = *(*bytes)++;
+    *value |= uint32_t(byte&0x7f)<<shift;
+    if (!(byte&0x80)) { return true; }
+  }
+  return false;
+}
+
+static inline uint32_t zigzag(int value)     { return (uint32_t(value)<<1)^uint32_t(value>>31); }
+static inline int      unzigzag(uint32_t value) { return int(value>>1)^-int(value&1); }
+
+static bool writeNNFStreamHeader(FILE* stream,const NNFStreamHeader& header)
+{
+  std::vector<unsigned char> bytes;
+  putUint32(&bytes,nnfStreamMagic);
+  putUint32(&bytes,header.width);
+  putUint32(&bytes,header.height);
+  putUint32(&bytes,header.sourceWidth);
+  putUint32(&bytes,header.sourceHeight);
+  return fwrite(bytes.data(),bytes.size(),1,stream)==1;
+}
+
+static bool readNNFStreamHeader(FILE* stream,NNFStreamHeader* header)
+{
+  unsigned char bytes[20];
+  if (fread(bytes,sizeof(bytes),1,stream)!=1 || getUint32(bytes)!=nnfStreamMagic) { return false; }
+  header->width = getUint32(&bytes[4]);
+  header->height = getUint32(&bytes[8]);
+  header->sourceWidth = getUint32(&bytes[12]);
+  header->sourceHeight = getUint32(&bytes[16]);
+  return header->width>0 && header->height>0 && header->sourceWidth>0 && header->sourceHeight>0;
+}
+
+// Upper bound of the payload of a width x height frame: the flags, the table
+// size, and per pixel at most one literal run (length and id varints) plus
+// its table entry (two varints), 5 bytes per varint.
+static inline uint64_t maxNNFPayloadSize(int width,int height)
+{
+  return 1+5+uint64_t(width)*height*4*5;
+}
+
+// Reads the next frame record; returns false at the end of the stream or
+// when the record claims more than a width x height frame can take.
+static bool readNNFFrame(FILE* stream,int width,int height,int* frame,std::vector<unsigned char>* payload)
+{
+  unsigned char bytes[8];
+  if (fread(bytes,sizeof(bytes),1,stream)!=1) { return false; }
+  *frame = int(getUint32(&bytes[4]));
+  if (getUint32(bytes)>maxNNFPayloadSize(width,height)) { return false; }
+  payload->resize(getUint32(bytes));
+  return payload->empty() || fread(payload->data(),payload->size(),1,stream)==1;
+}
+
+struct NNFEncoder
+{
+  int width;
+  int height;
+  int keyframeInterval;  // 0 makes only the first frame a keyframe
+  int numFrames;
+  std::vector<uint64_t> previous;
+  std::vector<uint64_t> current;
+  std::vector<uint64_t> table;
+  std::unordered_map<uint64_t,uint32_t> tableIds;
+  std::vector<unsigned char> runs;
+};
+
+static void createNNFEncoder(NNFEncoder* encoder,int width,int height,int keyframeInterval)
+{
+  encoder->width = width;
+  encoder->height = height;
+  encoder->keyframeInterval = keyframeInterval;
+  encoder->numFrames = 0;
+  encoder->previous.assign(size_t(width)*height,nnfMaskedEntry);
+  encoder->current.resize(size_t(width)*height);
+}
+
+static inline int runLength(const uint64_t* a,const uint64_t* b,int count)
+{
+  int length = 0;
+  while (length<count && a[length]==b[length]) { length++; }
+  return length;
+}
+
+// Appends the record of one frame to out. The NNF is the RGBA8 read back
+// from styleblitNNF(), the mask is the alpha of the guide, both bottom-up.
+static void encodeNNFFrame(NNFEncoder* encoder,int frame,const unsigned char* nnf,const unsigned char* guide,std::vector<unsigned char>* out)
+{
+  const int width = encoder->width;
+  const int height = encoder->height;
+  const bool keyframe = (encoder->numFrames==0) || (encoder->keyframeInterval>0 && encoder->numFrames%encoder->keyframeInterval==0);
+
+  uint64_t* current = encoder->current.data();
+  for(int y=0;y<height;y++)
+  for(int x=0;x<width;x++)
+  {
+    const size_t i = size_t(y)*width+x;
+    const unsigned char* rgba = &nnf[i*4];
+    current[i] = (guide[i*4+3]>0) ? nnfEntry(rgba[0]+rgba[1]*255-x,rgba[2]+rgba[3]*255-y) : nnfMaskedEntry;
+  }
+
+  // greedily take the longest of the three runs, preferring the ones without
+  // an entry when they tie
+  encoder->table.clear();
+  encoder->tableIds.clear();
+  encoder->runs.clear();
+  std::vector<unsigned char>* runs = &encoder->runs;
+  for(int y=0;y<height;y++)
+  {
+    const uint64_t* row = &current[size_t(y)*width];
+    const uint64_t* previousRow = &encoder->previous[size_t(y)*width];
+    const uint64_t* rowBelow = row-width;
+    int x = 0;
+    while (x<width)
+    {
+      const int count = width-x;
+      const int previousLength = keyframe ? 0 : runLength(&row[x],&previousRow[x],count);
+      const int belowLength = (y>0) ? runLength(&row[x],&rowBelow[x],count) : 0;
+      int literalLength = 1;
+      while (literalLength<count && row[x+literalLength]==row[x]) { literalLength++; }
+
+      if (previousLength>=belowLength && previousLength>=literalLength)
+      {
+        putVarint(runs,(uint32_t(previousLength)<<2)|0);
+        x += previousLength;
+      }
+      else if (belowLength>=literalLength)
+      {
+        putVarint(runs,(uint32_t(belowLength)<<2)|1);
+        x += belowLength;
+      }
+      else
+      {
+        uint32_t id = 0;
+        if (row[x]!=nnfMaskedEntry)
+        {
+          std::unordered_map<uint64_t,uint32_t>::iterator it = encoder->tableIds.find(row[x]);
+          if (it==encoder->tableIds.end())
+          {
+            encoder->table.push_back(row[x]);
+            it = encoder->tableIds.insert(std::make_pair(row[x],uint32_t(encoder->table.size()))).first;
+          }
+          id = it->second;
+        }
+        putVarint(runs,(uint32_t(literalLength)<<2)|2);
+        putVarint(runs,id);
+        x += literalLength;
+      }
+    }
+  }
+
+  const size_t recordStart = out->size();
+  putUint32(out,0);
+  putUint32(out,uint32_t(frame));
+  out->push_back(keyframe ? 1 : 0);
+  putVarint(out,encoder->table.size());
+  int dx = 0;
+  int dy = 0;
+  for(int i=0;i<encoder->table.size();i++)
+  {
+    putVarint(out,zigzag(nnfEntryX(encoder->table[i])-dx));
+    putVarint(out,zigzag(nnfEntryY(encoder->table[i])-dy));
+    dx = nnfEntryX(encoder->table[i]);
+    dy = nnfEntryY(encoder->table[i]);
+  }
+  out->insert(out->end(),runs->begin(),runs->end());
+
+  const uint32_t payloadSize = uint32_t(out->size()-recordStart-8);
+  for(int i=0;i<4;i++) { (*out)[recordStart+i] = (payloadSize>>(i*8))&0xff; }
+
+  std::swap(encoder->previous,encoder->current);
+  encoder->numFrames++;
+}
+
+struct NNFDecoder
+{
+  int width;
+  int height;
+  bool started;
+  std::vector<uint64_t> previous;
+  std::vector<uint64_t> current;
+  std::vector<uint64_t> table;
+};
+
+static void createNNFDecoder(NNFDecoder* decoder,int width,int height)
+{
+  decoder->width = width;
+  decoder->height = height;
+  decoder->started = false;
+  decoder->previous.assign(size_t(width)*height,nnfMaskedEntry);
+  decoder->current.resize(size_t(width)*height);
+}
+
+// Decodes a frame payload into the RGBA8 NNF styleblitBlend takes and a mask
+// (0 or 255 in all channels), both bottom-up. Fails on a corrupt payload or
+// when the stream doesn't start at a keyframe.
+static bool decodeNNFFrame(NNFDecoder* decoder,const std::vector<unsigned char>& payload,unsigned char* nnf,unsigned char* mask)
+{
+  const int width = decoder->width;
+  const int height = decoder->height;
+  const unsigned char* bytes = payload.data();
+  const unsigned char* end = bytes+payload.size();
+
+  if (bytes==end) { return false; }
+  const bool keyframe = (*bytes++ & 1)!=0;
+  if (!keyframe && !decoder->started) { return false; }
+
+  uint32_t tableSize;
+  if (!getVarint(&bytes,end,&tableSize) || tableSize>payload.size()) { return false; }
+  decoder->table.resize(tableSize+1);
+  decoder->table[0] = nnfMaskedEntry;
+  int dx = 0;
+  int dy = 0;
+  for(uint32_t i=1;i<=tableSize;i++)
+  {
+    uint32_t zx,zy;
+    if (!getVarint(&bytes,end,&zx) || !getVarint(&bytes,end,&zy)) { return false; }
+    dx += unzigzag(zx);
+    dy += unzigzag(zy);
+    decoder->table[i] = nnfEntry(dx,dy);
+  }
+
+  uint64_t* current = decoder->current.data();
+  for(int y=0;y<height;y++)
+  {
+    uint64_t* row = &current[size_t(y)*width];
+    const uint64_t* previousRow = &decoder->previous[size_t(y)*width];
+    int x = 0;
+    while (x<width)
+    {
+      uint32_t run;
+      if (!getVarint(&bytes,end,&run)) { return false; }
+      const int type = run&3;
+      const uint32_t length = run>>2;
+      if (length==0 || length>uint32_t(width-x)) { return false; }
+
+      if (type==0 && !keyframe) { memcpy(&row[x],&previousRow[x],length*sizeof(uint64_t)); }
+      else if (type==1 && y>0)  { memcpy(&row[x],&row[x-width],length*sizeof(uint64_t)); }
+      else if (type==2)
+      {
+        uint32_t id;
+        if (!getVarint(&bytes,end,&id) || id>tableSize) { return false; }
+        std::fill(&row[x],&row[x+length],decoder->table[id]);
+      }
+      else { return false; }
+      x += length;
+    }
+  }
+
+  for(int y=0;y<height;y++)
+  for(int x=0;x<width;x++)
+  {
+    const size_t i = size_t(y)*width+x;
+    unsigned char* rgba = &nnf[i*4];
+    if (current[i]==nnfMaskedEntry)
+    {
+      memset(rgba,0,4);
+      memset(&mask[i*4],0,4);
+      continue;
+    }
+    const int sx = x+nnfEntryX(current[i]);
+    const int sy = y+nnfEntryY(current[i]);
+    rgba[0] = sx%255; rgba[1] = sx/255;
+    rgba[2] = sy%255; rgba[3] = sy/255;
+    memset(&mask[i*4],255,4);
+  }
+
+  std::swap(decoder->previous,decoder->current);
+  decoder->started = true;
+  return true;
+}
+
+#endif
@@ -0,0 +1,93 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef PRESETS_H_
+#define PRESETS_H_
+
+// Quality/performance presets of one style, as found by styleblit --tune (see
+// autotune.h): the settings on the Pareto frontier of frame time, guide error
+// and chunk size, fastest first. A text file of the form
+//
+//   # comments
+//   default 2
+//   # threshold blendRadius coarsestLevel scale grid ms error chunk
+//   16 0 4 0.50 1 3.10 21.52 6.4
+//   24 1 6 1.00 0 11.87 8.04 15.2
+//   ...
+//
+// where scale is the resolution the target is stylized at relative to the
+// output, grid selects STYLEBLIT_NO_JITTER, and ms, error and chunk are what
+// the tuner measured (for information only). default is the index of the
+// preset the app starts with.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "styleblit.h"
+
+struct Preset
+{
+  float threshold;
+  int   blendRadius;
+  int   coarsestLevel;
+  float scale;
+  bool  grid;
+  float ms;
+  float error;
+  float chunkSize;
+};
+
+static int presetFlags(const Preset& preset)
+{
+  return STYLEBLIT_COARSEST_LEVEL(preset.coarsestLevel) | (preset.grid ? STYLEBLIT_NO_JITTER : 0);
+}
+
+static bool loadPresets(const char* fileName,std::vector<Preset>* out_presets,int* out_defaultPreset)
+{
+  FILE* f = fopen(fileName,"r");
+  if (!f) { return false; }
+
+  std::vector<Preset> presets;
+  int defaultPreset = 0;
+  char line[256];
+  while (fgets(line,sizeof(line),f))
+  {
+    if (line[0]=='#') { continue; }
+    if (sscanf(line,"default %d",&defaultPreset)==1) { continue; }
+
+    Preset preset;
+    int grid = 0;
+    preset.ms = preset.error = preset.chunkSize = 0;
+    if (sscanf(line,"%f %d %d %f %d %f %f %f",&preset.threshold,&preset.blendRadius,&preset.coarsestLevel,&preset.scale,&grid,&preset.ms,&preset.error,&preset.chunkSize)<5) { continue; }
+    if (preset.blendRadius<0 || preset.coarsestLevel<0 || preset.coarsestLevel>6 || !(preset.scale>0.0f && preset.scale<=1.0f)) { continue; }
+    preset.grid = (grid!=0);
+    presets.push_back(preset);
+  }
+  fclose(f);
+
+  if (presets.empty()) { return false; }
+  *out_presets = presets;
+  *out_defaultPreset = (defaultPreset>=0 && defaultPreset<presets.size()) ? defaultPreset : 0;
+  return true;
+}
+
+static bool savePresets(const char* fileName,const std::vector<Preset>& presets,int defaultPreset,const char* comment)
+{
+  FILE* f = fopen(fileName,"w");
+  if (!f) { return false; }
+
+  fprintf(f,"# %s\n",comment);
+  fprintf(f,"default %d\n",defaultPreset);
+  fprintf(f,"# threshold blendRadius coarsestLevel scale grid ms error chunk\n");
+  for(int i=0;i<presets.size();i++)
+  {
+    const Preset& p = presets[i];
+    fprintf(f,"%g %d %d %.2f %d %.2f %.2f %.1f\n",p.threshold,p.blendRadius,p.coarsestLevel,p.scale,p.grid ? 1 : 0,p.ms,p.error,p.chunkSize);
+  }
+
+  return fclose(f)==0;
+}
+
+#endif
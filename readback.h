@@ -0,0 +1,120 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef READBACK_H_
+#define READBACK_H_
+
+// Asynchronous readback of rendered frames. glReadPixels goes into a pixel
+// pack buffer and returns right away, a fence marks when the copy is done.
+// A frame is handed to the consumer only once its fence has signaled (or when
+// the ring is full and its slot is needed), so with three slots the GPU can
+// already work on frame N+2 while the consumer handles frame N.
+// Desktop only, WebGL 1 has neither pack buffers nor fences.
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <vector>
+
+struct ReadbackRing
+{
+  int width;
+  int height;
+  std::vector<GLuint> buffers;
+  std::vector<GLsync> fences;
+  std::vector<int>    frames;
+  int oldest;
+  int numPending;
+};
+
+static void createReadbackRing(ReadbackRing* ring,int width,int height,int numSlots)
+{
+  ring->width = width;
+  ring->height = height;
+  ring->buffers.resize(numSlots);
+  ring->fences.assign(numSlots,(GLsync)0);
+  ring->frames.assign(numSlots,0);
+  ring->oldest = 0;
+  ring->numPending = 0;
+
+  glGenBuffers(numSlots,ring->buffers.data());
+  for(int i=0;i<numSlots;i++)
+  {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER,ring->buffers[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER,size_t(width)*height*4,0,GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+}
+
+// Hands the oldest queued frame to consumer(frame,pixels) once its fence has
+// signaled; pixels are bottom-up RGBA and only valid during the call. Returns
+// false if the frame isn't done yet and wait is not set.
+template<typename F>
+static bool retireOldestReadback(ReadbackRing* ring,bool wait,const F& consumer)
+{
+  const int slot = ring->oldest;
+
+  GLenum status;
+  do { status = glClientWaitSync(ring->fences[slot],GL_SYNC_FLUSH_COMMANDS_BIT,wait ? GLuint64(1000000000) : 0); }
+  while (status==GL_TIMEOUT_EXPIRED && wait);
+  if (status==GL_TIMEOUT_EXPIRED) { return false; }
+
+  glDeleteSync(ring->fences[slot]);
+  ring->fences[slot] = 0;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,ring->buffers[slot]);
+  const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER,0,size_t(ring->width)*ring->height*4,GL_MAP_READ_BIT);
+  if (pixels) { consumer(ring->frames[slot],pixels); glUnmapBuffer(GL_PIXEL_PACK_BUFFER); }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+
+  ring->oldest = (ring->oldest+1)%int(ring->buffers.size());
+  ring->numPending--;
+  return true;
+}
+
+// Hands all finished frames to the consumer in the order they were queued.
+// With wait set it blocks until every queued frame is done.
+template<typename F>
+static void retireReadbacks(ReadbackRing* ring,bool wait,const F& consumer)
+{
+  while (ring->numPending>0 && retireOldestReadback(ring,wait,consumer)) { }
+}
+
+// Queues the readback of the bound read framebuffer as the given frame. When
+// all slots are taken it first waits for the oldest one.
+template<typename F>
+static void readbackFrame(ReadbackRing* ring,int frame,const F& consumer)
+{
+  const int numSlots = ring->buffers.size();
+
+  retireReadbacks(ring,false,consumer);
+  if (ring->numPending==numSlots) { retireOldestReadback(ring,true,consumer); }
+
+  const int slot = (ring->oldest+ring->numPending)%numSlots;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,ring->buffers[slot]);
+  glPixelStorei(GL_PACK_ALIGNMENT,4);
+  glReadPixels(0,0,ring->width,ring->height,GL_RGBA,GL_UNSIGNED_BYTE,0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+  ring->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+  ring->frames[slot] = frame;
+  ring->numPending++;
+}
+
+static void destroyReadbackRing(ReadbackRing* ring)
+{
+  for(int i=0;i<ring->fences.size();i++)
+  {
+    if (ring->fences[i]) { glDeleteSync(ring->fences[i]); }
+  }
+  glDeleteBuffers(ring->buffers.size(),ring->buffers.data());
+  ring->buffers.clear();
+  ring->fences.clear();
+  ring->frames.clear();
+  ring->numPending = 0;
+}
+
+#endif
@@ -0,0 +1,415 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef SEQUENCE_H_
+#define SEQUENCE_H_
+
+// Offline stylization of a numbered sequence of guide images. The frames are
+// streamed through fixed rings of buffers, so memory use stays constant no
+// matter how long the sequence is:
+//
+//   reader thread  decodes frame i+k into a mapped pixel unpack buffer
+//   main thread    uploads it, stylizes it into an offscreen texture and
+//                  queues an asynchronous readback (see readback.h), the
+//                  finished ones go to a slot of the output ring
+//   writer thread  hands the slot to a FrameSink (see framesink.h)
+//
+// Desktop only, the web build has neither threads nor a file system to
+// stream from. Expects stb_image.h to be included before.
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "styleblit.h"
+#include "readback.h"
+#include "framesink.h"
+#include "nnfcodec.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct SequenceOptions
+{
+  const char* guidePattern;  // printf pattern of the guide file names, e.g. "guides/%04d.png"
+  const char* maskPattern;   // optional, its first channel replaces the guide alpha
+  int firstFrame;
+  int numFrames;
+  int jitterPeriod;          // re-jitter every jitterPeriod frames, 0 never
+  int ringSize;              // frames in flight between the threads
+};
+
+// Slot indices handed over between two threads. pop() blocks until there is
+// a slot or the queue is closed.
+struct SlotQueue
+{
+  std::deque<int> slots;
+  bool closed;
+  std::mutex mutex;
+  std::condition_variable condition;
+
+  SlotQueue() : closed(false) { }
+
+  void push(int slot)
+  {
+    { std::lock_guard<std::mutex> lock(mutex); slots.push_back(slot); }
+    condition.notify_one();
+  }
+
+  bool pop(int* out_slot)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (slots.empty() && !closed) { condition.wait(lock); }
+    if (slots.empty()) { return false; }
+    *out_slot = slots.front();
+    slots.pop_front();
+    return true;
+  }
+
+  void close()
+  {
+    { std::lock_guard<std::mutex> lock(mutex); closed = true; }
+    condition.notify_all();
+  }
+};
+
+// Decodes the guide (and mask) of one frame into dst, bottom-up RGBA. The
+// caller sets stbi_set_flip_vertically_on_load(1) before, the flag is global
+// and this runs on the reader thread.
+static bool loadSequenceFrame(const SequenceOptions& options,int frame,int width,int height,unsigned char* dst)
+{
+  const std::string guideFileName = frameFileName(options.guidePattern,frame);
+  int guideWidth,guideHeight;
+  unsigned char* guide = stbi_load(guideFileName.c_str(),&guideWidth,&guideHeight,NULL,4);
+  if (!guide) { fprintf(stderr,"failed to load %s\n",guideFileName.c_str()); return false; }
+  if (guideWidth!=width || guideHeight!=height) { fprintf(stderr,"%s is %dx%d, expected %dx%d\n",guideFileName.c_str(),guideWidth,guideHeight,width,height); stbi_image_free(guide); return false; }
+  memcpy(dst,guide,size_t(width)*height*4);
+  stbi_image_free(guide);
+
+  if (!options.maskPattern) { return true; }
+
+  const std::string maskFileName = frameFileName(options.maskPattern,frame);
+  int maskWidth,maskHeight;
+  unsigned char* mask = stbi_load(maskFileName.c_str(),&maskWidth,&maskHeight,NULL,1);
+  if (!mask) { fprintf(stderr,"failed to load %s\n",maskFileName.c_str()); return false; }
+  if (maskWidth!=width || maskHeight!=height) { fprintf(stderr,"%s is %dx%d, expected %dx%d\n",maskFileName.c_str(),maskWidth,maskHeight,width,height); stbi_image_free(mask); return false; }
+  for(size_t i=0;i<size_t(width)*height;i++) { dst[i*4+3] = mask[i]; }
+  stbi_image_free(mask);
+
+  return true;
+}
+
+// Stylizes options.numFrames guides with the given exemplar into sink.
+// Needs a current GL 3 context (which may belong to a hidden window).
+// The upload ring consists of pixel unpack buffers which are kept mapped
+// while the reader fills them, and are only unmapped for the upload itself.
+// Mapping them once persistently would need GL 4.4 which macOS lacks.
+static bool stylizeSequence(const SequenceOptions& options,
+                            FrameSink* sink,
+                            int sourceWidth,
+                            int sourceHeight,
+                            GLuint texSourceNormals,
+                            GLuint texSourceStyle,
+                            float threshold,
+                            int blendRadius)
+{
+  if (options.numFrames<=0) { return true; }
+
+  int width,height;
+  const std::string firstFileName = frameFileName(options.guidePattern,options.firstFrame);
+  if (!stbi_info(firstFileName.c_str(),&width,&height,NULL)) { fprintf(stderr,"failed to load %s\n",firstFileName.c_str()); return false; }
+
+  // the guides are uploaded bottom-up like every other texture, and the app
+  // only sets the flag when it decodes PNGs itself (not with an asset pack)
+  stbi_set_flip_vertically_on_load(1);
+
+  const int ringSize = std::max(options.ringSize,2);
+  const size_t guideSize = size_t(width)*height*4;
+  // sinks storing NNFs get the NNF and the guide of each frame instead
+  const bool keepNNF = sink->wantsNNF();
+  const size_t outputSize = size_t(width)*height*4*(keepNNF ? 2 : 1);
+
+  std::vector<GLuint> guideBuffers(ringSize);
+  std::vector<unsigned char*> guideSlots(ringSize,(unsigned char*)0);
+  std::vector<char> guideLoaded(ringSize,0);
+  glGenBuffers(ringSize,guideBuffers.data());
+
+  std::vector<unsigned char> outputPixels(outputSize*ringSize);
+  std::vector<int> outputFrames(ringSize,0);
+
+  SlotQueue freeGuides,filledGuides;
+  SlotQueue freeOutputs,filledOutputs;
+
+  // The buffer is orphaned before each mapping so the driver doesn't have to
+  // wait for the upload still reading from it.
+  for(int i=0;i<ringSize;i++)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER,guideBuffers[i]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER,guideSize,0,GL_STREAM_DRAW);
+    guideSlots[i] = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,0,guideSize,GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT);
+    freeGuides.push(i);
+    freeOutputs.push(i);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+
+  GLuint texGuide,texOutput,fboOutput;
+  glGenTextures(1,&texGuide);
+  glBindTexture(GL_TEXTURE_2D,texGuide);
+  glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,width,height,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+
+  glGenTextures(1,&texOutput);
+  glBindTexture(GL_TEXTURE_2D,texOutput);
+  glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,width,height,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+
+  glGenFramebuffers(1,&fboOutput);
+  glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,texOutput,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+
+  // the reader walks the frames in order and so do the slots it fills,
+  // the main thread can take them in the order they were pushed
+  std::thread reader([&]()
+  {
+    for(int i=0;i<options.numFrames;i++)
+    {
+      int slot;
+      if (!freeGuides.pop(&slot)) { break; }
+      guideLoaded[slot] = guideSlots[slot] && loadSequenceFrame(options,options.firstFrame+i,width,height,guideSlots[slot]);
+      filledGuides.push(slot);
+      if (!guideLoaded[slot]) { break; }
+    }
+    filledGuides.close();
+  });
+
+  bool written = true;
+  std::thread writer([&]()
+  {
+    int slot;
+    while (filledOutputs.pop(&slot))
+    {
+      const unsigned char* pixels = &outputPixels[outputSize*slot];
+      if (written && !(keepNNF ? sink->writeNNF(outputFrames[slot],width,height,sourceWidth,sourceHeight,pixels,pixels+guideSize)
+                               : sink->writeFrame(outputFrames[slot],width,height,pixels)))
+      {
+        fprintf(stderr,"failed to write frame %d\n",outputFrames[slot]);
+        written = false;
+      }
+      freeOutputs.push(slot);
+    }
+  });
+
+  // finished readbacks are copied out of the mapped pack buffer into a slot of
+  // the writer ring; for sinks storing NNFs the ring reads the NNF, and the
+  // guide, copied from its upload slot, waits for it in pendingGuides
+  const int numReadbackSlots = 3;
+  ReadbackRing readbackRing;
+  createReadbackRing(&readbackRing,width,height,numReadbackSlots);
+  std::vector<unsigned char> pendingGuides(keepNNF ? guideSize*(numReadbackSlots+1) : 0);
+  const auto handOver = [&](int frame,const unsigned char* pixels)
+  {
+    int slot;
+    if (!freeOutputs.pop(&slot)) { return; }
+    memcpy(&outputPixels[outputSize*slot],pixels,guideSize);
+    if (keepNNF) { memcpy(&outputPixels[outputSize*slot+guideSize],&pendingGuides[guideSize*(frame%(numReadbackSlots+1))],guideSize); }
+    outputFrames[slot] = frame;
+    filledOutputs.push(slot);
+  };
+
+  GLuint fboNNF = 0;
+  if (keepNNF) { glGenFramebuffers(1,&fboNNF); }
+
+  bool ok = true;
+  for(int i=0;i<options.numFrames;i++)
+  {
+    int guideSlot;
+    if (!filledGuides.pop(&guideSlot) || !guideLoaded[guideSlot]) { ok = false; break; }
+
+    if (keepNNF) { memcpy(&pendingGuides[guideSize*((options.firstFrame+i)%(numReadbackSlots+1))],guideSlots[guideSlot],guideSize); }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER,guideBuffers[guideSlot]);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindTexture(GL_TEXTURE_2D,texGuide);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+    glTexSubImage2D(GL_TEXTURE_2D,0,0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER,guideSize,0,GL_STREAM_DRAW);
+    guideSlots[guideSlot] = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,0,guideSize,GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+    freeGuides.push(guideSlot);
+
+    const bool jitter = (i==0) || (options.jitterPeriod>0 && i%options.jitterPeriod==0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+    glViewport(0,0,width,height);
+
+    styleblit(width,
+              height,
+              texGuide,
+              sourceWidth,
+              sourceHeight,
+              texSourceNormals,
+              texSourceStyle,
+              threshold,
+              blendRadius,
+              jitter,
+              keepNNF ? STYLEBLIT_KEEP_NNF : 0);
+
+    // the copy into the pack buffer is queued before the next call can
+    // overwrite the NNF texture
+    if (keepNNF)
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER,fboNNF);
+      glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,styleblitNNF(),0);
+    }
+    readbackFrame(&readbackRing,options.firstFrame+i,handOver);
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+  }
+  retireReadbacks(&readbackRing,true,handOver);
+  destroyReadbackRing(&readbackRing);
+
+  freeGuides.close();
+  filledOutputs.close();
+  reader.join();
+  writer.join();
+
+  for(int i=0;i<ringSize;i++)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER,guideBuffers[i]);
+    if (guideSlots[i]) { glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); }
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+  glDeleteBuffers(ringSize,guideBuffers.data());
+  if (fboNNF!=0) { glDeleteFramebuffers(1,&fboNNF); }
+  glDeleteFramebuffers(1,&fboOutput);
+  glDeleteTextures(1,&texOutput);
+  glDeleteTextures(1,&texGuide);
+
+  return ok && written;
+}
+
+// Blend-only playback of an NNF stream written through an "nnf:" sink. A
+// reader thread decodes the frames ahead into a ring of ringSize slots, the
+// main thread uploads them and runs only the blend pass with the given
+// exemplar, which has to be of the source size stored in the header.
+static bool blendSequence(FILE* stream,
+                          const NNFStreamHeader& header,
+                          FrameSink* sink,
+                          GLuint texSourceStyle,
+                          int blendRadius,
+                          int ringSize)
+{
+  const int width = header.width;
+  const int height = header.height;
+  const size_t frameSize = size_t(width)*height*4;
+
+  ringSize = std::max(ringSize,2);
+  std::vector<unsigned char> decoded(frameSize*2*ringSize);
+  std::vector<int> decodedFrames(ringSize,0);
+  std::vector<char> decodedOk(ringSize,0);
+
+  SlotQueue freeSlots,filledSlots;
+  for(int i=0;i<ringSize;i++) { freeSlots.push(i); }
+
+  GLuint textures[3];
+  glGenTextures(3,textures);
+  const GLuint texNNF = textures[0];
+  const GLuint texMask = textures[1];
+  const GLuint texOutput = textures[2];
+  for(int i=0;i<3;i++)
+  {
+    glBindTexture(GL_TEXTURE_2D,textures[i]);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,width,height,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+  }
+
+  GLuint fboOutput;
+  glGenFramebuffers(1,&fboOutput);
+  glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,texOutput,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+
+  // a slot comes back empty-handed at the end of the stream or on an error
+  std::thread reader([&]()
+  {
+    NNFDecoder decoder;
+    createNNFDecoder(&decoder,width,height);
+    std::vector<unsigned char> payload;
+    int slot;
+    while (freeSlots.pop(&slot))
+    {
+      unsigned char* nnf = &decoded[frameSize*2*slot];
+      decodedOk[slot] = readNNFFrame(stream,width,height,&decodedFrames[slot],&payload) && decodeNNFFrame(&decoder,payload,nnf,nnf+frameSize);
+      filledSlots.push(slot);
+      if (!decodedOk[slot]) { break; }
+    }
+    filledSlots.close();
+  });
+
+  bool written = true;
+  const auto writeOut = [&](int frame,const unsigned char* pixels)
+  {
+    if (written && !sink->writeFrame(frame,width,height,pixels))
+    {
+      fprintf(stderr,"failed to write frame %d\n",frame);
+      written = false;
+    }
+  };
+
+  ReadbackRing readbackRing;
+  createReadbackRing(&readbackRing,width,height,3);
+
+  bool ok = true;
+  int slot;
+  while (filledSlots.pop(&slot))
+  {
+    if (!decodedOk[slot])
+    {
+      if (!feof(stream)) { fprintf(stderr,"corrupt NNF stream\n"); ok = false; }
+      break;
+    }
+
+    const unsigned char* nnf = &decoded[frameSize*2*slot];
+    glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+    glBindTexture(GL_TEXTURE_2D,texNNF);
+    glTexSubImage2D(GL_TEXTURE_2D,0,0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,nnf);
+    glBindTexture(GL_TEXTURE_2D,texMask);
+    glTexSubImage2D(GL_TEXTURE_2D,0,0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,nnf+frameSize);
+    const int frame = decodedFrames[slot];
+    freeSlots.push(slot);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+    styleblitBlend(width,height,texMask,texNNF,header.sourceWidth,header.sourceHeight,texSourceStyle,blendRadius);
+    readbackFrame(&readbackRing,frame,writeOut);
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+  }
+  retireReadbacks(&readbackRing,true,writeOut);
+  destroyReadbackRing(&readbackRing);
+
+  freeSlots.close();
+  reader.join();
+
+  glDeleteFramebuffers(1,&fboOutput);
+  glDeleteTextures(3,textures);
+
+  return ok && written;
+}
+
+#endif
@@ -13,6 +13,8 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 
 static GLuint createTexture2D(GLint format,int width,int height,GLint filter,GLint wrap)
 {
@@ -64,9 +66,24 @@ static GLuint compileShader(GLenum type,const GLchar* source)
   return shader;
 }
 
+static void printProgramLog(GLuint program)
+{
+  GLint logLength = 0;
+  glGetProgramiv(program,GL_INFO_LOG_LENGTH,&logLength);
+
+  if (logLength>0)
+  {
+    char* infoLog = new char[logLength];
+    glGetProgramInfoLog(program,logLength,&logLength,infoLog);
+    printf("%s",infoLog);
+    delete[] infoLog;
+  }
+}
+
 static GLuint createProgram(const char* vertexShaderFileName,
                             const char* fragmentShaderFileName,
-                            const char* fragmentShaderPrefix = "")
+                            const char* fragmentShaderPrefix = "",
+                            const char* geometryShaderFileName = 0)
 { 
   const char* vertexShaderSource = stringFromFile(vertexShaderFileName);
   const char* fragmentShaderSource = stringFromFile(fragmentShaderFileName,fragmentShaderPrefix);
@@ -79,27 +96,29 @@ static GLuint createProgram(const char* vertexShaderFileName,
   glAttachShader(program,vertexShader);
   glAttachShader(program,fragmentShader);
 
-  glLinkProgram(program);
-
-  GLint linkStatus;
-  glGetProgramiv(program,GL_LINK_STATUS,&linkStatus);
-
-  GLint logLength = 0;
-  glGetProgramiv(program,GL_INFO_LOG_LENGTH,&logLength);
-
-  if (logLength>0)
+#ifndef __EMSCRIPTEN__
+  GLuint geometryShader = 0;
+  if (geometryShaderFileName)
   {
-    char* infoLog = new char[logLength];
-    glGetProgramInfoLog(program,logLength,&logLength,infoLog);
-    printf("%s",infoLog);
-    delete[] infoLog;
+    const char* geometryShaderSource = stringFromFile(geometryShaderFileName);
+    geometryShader = compileShader(GL_GEOMETRY_SHADER,geometryShaderSource);
+    glAttachShader(program,geometryShader);
+    delete[] geometryShaderSource;
   }
+#endif
+
+  glLinkProgram(program);
+  printProgramLog(program);
 
   glDetachShader(program,vertexShader);
   glDetachShader(program,fragmentShader);
 
   glDeleteShader(vertexShader);
   glDeleteShader(fragmentShader);
+
+#ifndef __EMSCRIPTEN__
+  if (geometryShader!=0) { glDetachShader(program,geometryShader); glDeleteShader(geometryShader); }
+#endif
   
   delete[] vertexShaderSource;
   delete[] fragmentShaderSource;
@@ -107,7 +126,44 @@ static GLuint createProgram(const char* vertexShaderFileName,
   return program;
 }
 
-static void drawFullscreenTriangle(GLint positionLocation)
+#if !defined(__EMSCRIPTEN__) && !defined(__APPLE__)
+// Compute shaders need GL 4.3. macOS stops at 4.1, so the compute path isn't
+// built there at all.
+static bool computeSupported()
+{
+  static int supported = -1;
+  if (supported<0)
+  {
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION,&major);
+    glGetIntegerv(GL_MINOR_VERSION,&minor);
+    supported = (major>4 || (major==4 && minor>=3)) ? 1 : 0;
+  }
+  return supported==1;
+}
+
+static GLuint createComputeProgram(const char* computeShaderFileName,const char* computeShaderPrefix)
+{
+  const char* computeShaderSource = stringFromFile(computeShaderFileName,computeShaderPrefix);
+  const GLuint computeShader = compileShader(GL_COMPUTE_SHADER,computeShaderSource);
+
+  const GLuint program = glCreateProgram();
+  glAttachShader(program,computeShader);
+  glLinkProgram(program);
+  printProgramLog(program);
+
+  glDetachShader(program,computeShader);
+  glDeleteShader(computeShader);
+  delete[] computeShaderSource;
+
+  return program;
+}
+#endif
+
+// With numInstances>1 the triangle is drawn once per layer of a layered
+// framebuffer (the geometry shader picks the layer by the instance).
+static void drawFullscreenTriangle(GLint positionLocation,int numInstances = 1)
 {
   static GLuint vbo = 0;
   static GLuint vao = 0;
@@ -137,6 +193,10 @@ static void drawFullscreenTriangle(GLint positionLocation)
   glBindBuffer(GL_ARRAY_BUFFER,vbo);
   glVertexAttribPointer(positionLocation,3,GL_FLOAT,GL_FALSE,0,0);
   glEnableVertexAttribArray(positionLocation);
+#ifndef __EMSCRIPTEN__
+  if (numInstances>1) { glDrawArraysInstanced(GL_TRIANGLES,0,3,numInstances); }
+  else
+#endif
   glDrawArrays(GL_TRIANGLES,0,3);
   glDisableVertexAttribArray(positionLocation);
 
@@ -144,6 +204,706 @@ static void drawFullscreenTriangle(GLint positionLocation)
   glBindBuffer(GL_ARRAY_BUFFER,0);
 }
 
+static void drawRects(GLint positionLocation,const std::vector<int>& rects,int targetWidth,int targetHeight)
+{
+  static GLuint vbo = 0;
+  static GLuint vao = 0;
+
+  if (vbo==0) { glGenBuffers(1,&vbo); }
+  if (vao==0) { glGenVertexArrays(1,&vao); }
+
+  std::vector<float> vertices;
+  vertices.reserve((rects.size()/4)*6*3);
+  for(int i=0;i<rects.size();i+=4)
+  {
+    const float x0 = 2.0f*float(rects[i+0])/float(targetWidth)-1.0f;
+    const float y0 = 2.0f*float(rects[i+1])/float(targetHeight)-1.0f;
+    const float x1 = 2.0f*float(rects[i+2])/float(targetWidth)-1.0f;
+    const float y1 = 2.0f*float(rects[i+3])/float(targetHeight)-1.0f;
+    const float quad[] = { x0, y0, 0,
+                           x1, y0, 0,
+                           x1, y1, 0,
+                           x1, y1, 0,
+                           x0, y1, 0,
+                           x0, y0, 0 };
+    vertices.insert(vertices.end(),quad,quad+18);
+  }
+
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER,vbo);
+  glBufferData(GL_ARRAY_BUFFER,sizeof(float)*vertices.size(),vertices.data(),GL_STREAM_DRAW);
+  glVertexAttribPointer(positionLocation,3,GL_FLOAT,GL_FALSE,0,0);
+  glEnableVertexAttribArray(positionLocation);
+  glDrawArrays(GL_TRIANGLES,0,vertices.size()/3);
+  glDisableVertexAttribArray(positionLocation);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER,0);
+}
+
+// The incremental and time-sliced modes track changes of the target guide in
+// tiles. NearestSeed looks at the seeds of the 3x3 neighboring cells of the
+// coarsest level (64 px), so the NNF of a pixel depends on the guide up to
+// 2*64 px away.
+static const int tileSize = 32;
+static const int seedReach = 2*64;
+
+// The adaptive search keeps its level statistics in finer tiles: in 32 px
+// ones nearly every tile has some pixel that takes a coarse chunk.
+static const int levelTileSize = 8;
+
+// Work group sizes of the compute passes: the main pass is one invocation per
+// pixel, the blend pass stages a computeTileSize tile of the NNF plus the
+// blend radius around it in shared memory.
+static const int computeGroupSize = 8;
+static const int computeTileSize = 16;
+
+#if !defined(__EMSCRIPTEN__) && !defined(__APPLE__)
+// whether the blend pass tile with its halo of unpacked NNF entries (two
+// floats each) fits into shared memory
+static bool computeTileFits(int blendRadius)
+{
+  GLint maxSharedMemory = 0;
+  glGetIntegerv(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE,&maxSharedMemory);
+  const int apronSize = computeTileSize+2*blendRadius;
+  return apronSize*apronSize*2*int(sizeof(float))<=maxSharedMemory;
+}
+#endif
+
+// Grows the set of marked tiles by 'reach' tiles in every direction.
+static void growTiles(const std::vector<unsigned char>& tiles,
+                      int tilesX,
+                      int tilesY,
+                      int reach,
+                      std::vector<unsigned char>* out_grownTiles)
+{
+  std::vector<unsigned char> grownX(tilesX*tilesY,0);
+  std::vector<unsigned char>& grown = *out_grownTiles;
+  grown.assign(tilesX*tilesY,0);
+
+  for(int y=0;y<tilesY;y++)
+  for(int x=0;x<tilesX;x++)
+  {
+    if (!tiles[x+y*tilesX]) { continue; }
+    for(int i=std::max(x-reach,0);i<=std::min(x+reach,tilesX-1);i++) { grownX[i+y*tilesX] = 1; }
+  }
+
+  for(int y=0;y<tilesY;y++)
+  for(int x=0;x<tilesX;x++)
+  {
+    if (!grownX[x+y*tilesX]) { continue; }
+    for(int i=std::max(y-reach,0);i<=std::min(y+reach,tilesY-1);i++) { grown[x+i*tilesX] = 1; }
+  }
+}
+
+// Turns the marked tiles into rectangles (in target pixels), merging runs of
+// tiles within a row.
+static void tilesToRects(const std::vector<unsigned char>& tiles,
+                         int tilesX,
+                         int tilesY,
+                         int targetWidth,
+                         int targetHeight,
+                         std::vector<int>* out_rects)
+{
+  std::vector<int>& rects = *out_rects;
+  rects.clear();
+  for(int y=0;y<tilesY;y++)
+  {
+    int x = 0;
+    while (x<tilesX)
+    {
+      if (!tiles[x+y*tilesX]) { x++; continue; }
+      const int x0 = x;
+      while (x<tilesX && tiles[x+y*tilesX]) { x++; }
+      rects.push_back(x0*tileSize);
+      rects.push_back(y*tileSize);
+      rects.push_back(std::min(x*tileSize,targetWidth));
+      rects.push_back(std::min((y+1)*tileSize,targetHeight));
+    }
+  }
+}
+
+// Marks the tiles where the target guide differs from its copy taken at the
+// previous call in a tile-sized texture and refreshes the copy. Returns false
+// when there was nothing to compare (compare not set, or the first call at
+// this size), in which case every tile counts as changed and the texture
+// isn't written. Nothing is read back here.
+static bool diffTiles(int targetWidth,
+                      int targetHeight,
+                      GLuint texTargetNormals,
+                      bool compare,
+                      GLuint* out_texTiles,
+                      GLuint* out_fboTiles)
+{
+  static GLuint progDiff = 0;
+  static GLuint texPreviousTarget = 0;
+  static GLuint fboTarget = 0;
+  static GLuint texTiles = 0;
+  static GLuint fboTiles = 0;
+  static int previousWidth = 0;
+  static int previousHeight = 0;
+
+  const int tilesX = (targetWidth+tileSize-1)/tileSize;
+  const int tilesY = (targetHeight+tileSize-1)/tileSize;
+
+  if (progDiff==0)
+  {
+    char diffPrefix[256];
+    sprintf(diffPrefix,"#define TILE_SIZE %d\n",tileSize);
+    progDiff = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_diff.frag",diffPrefix);
+    texTiles = createTexture2D(GL_RGBA,tilesX,tilesY,GL_NEAREST,GL_CLAMP_TO_EDGE);
+    fboTiles = createFBO(texTiles);
+    texPreviousTarget = createTexture2D(GL_RGBA,targetWidth,targetHeight,GL_NEAREST,GL_CLAMP_TO_EDGE);
+    glGenFramebuffers(1,&fboTarget);
+    previousWidth = targetWidth;
+    previousHeight = targetHeight;
+    compare = false;
+  }
+
+  if (targetWidth!=previousWidth || targetHeight!=previousHeight)
+  {
+    glBindTexture(GL_TEXTURE_2D,texPreviousTarget);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,targetWidth,targetHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    glBindTexture(GL_TEXTURE_2D,texTiles);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,tilesX,tilesY,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    previousWidth = targetWidth;
+    previousHeight = targetHeight;
+    compare = false;
+  }
+
+  if (compare)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER,fboTiles);
+    glViewport(0,0,tilesX,tilesY);
+    glUseProgram(progDiff);
+    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,texTargetNormals);
+    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D,texPreviousTarget);
+    glUniform1i(glGetUniformLocation(progDiff,"target"),0);
+    glUniform1i(glGetUniformLocation(progDiff,"previousTarget"),1);
+    glUniform2f(glGetUniformLocation(progDiff,"targetSize"),targetWidth,targetHeight);
+    drawFullscreenTriangle(glGetAttribLocation(progDiff,"position"));
+  }
+
+  // copying an unchanged guide costs less than finding out it is unchanged
+  glBindFramebuffer(GL_FRAMEBUFFER,fboTarget);
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,texTargetNormals,0);
+  glBindTexture(GL_TEXTURE_2D,texPreviousTarget);
+  glCopyTexSubImage2D(GL_TEXTURE_2D,0,0,0,0,0,targetWidth,targetHeight);
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,0,0);
+
+  *out_texTiles = texTiles;
+  *out_fboTiles = fboTiles;
+  return compare;
+}
+
+// Reads the tiles marked by diffTiles for the time-sliced mode, which orders
+// its refresh on the CPU (and for the incremental mode in the WebGL build). The tiles go through a pixel pack buffer that is
+// mapped at the next call, so changed tiles are picked up one call late
+// rather than stalling on the diff pass. WebGL 1 has no pack buffers, there
+// they are read right away.
+static void readChangedTiles(int tilesX,
+                             int tilesY,
+                             bool compared,
+                             GLuint fboTiles,
+                             std::vector<unsigned char>* out_changedTiles)
+{
+  std::vector<unsigned char>& changedTiles = *out_changedTiles;
+  changedTiles.assign(tilesX*tilesY,compared ? 0 : 1);
+
+#ifdef __EMSCRIPTEN__
+  if (compared)
+  {
+    std::vector<unsigned char> tilePixels(tilesX*tilesY*4);
+    glBindFramebuffer(GL_FRAMEBUFFER,fboTiles);
+    glPixelStorei(GL_PACK_ALIGNMENT,1);
+    glReadPixels(0,0,tilesX,tilesY,GL_RGBA,GL_UNSIGNED_BYTE,tilePixels.data());
+    for(int i=0;i<tilesX*tilesY;i++) { changedTiles[i] = tilePixels[i*4]>0; }
+  }
+#else
+  static GLuint pbo = 0;
+  static bool pending = false;
+  static int pendingTilesX = 0;
+  static int pendingTilesY = 0;
+
+  if (pbo==0) { glGenBuffers(1,&pbo); }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,pbo);
+  if (pending && compared && tilesX==pendingTilesX && tilesY==pendingTilesY)
+  {
+    const unsigned char* tilePixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER,0,tilesX*tilesY*4,GL_MAP_READ_BIT);
+    if (tilePixels)
+    {
+      for(int i=0;i<tilesX*tilesY;i++) { changedTiles[i] = tilePixels[i*4]>0; }
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+  }
+  pending = false;
+
+  if (compared)
+  {
+    glBufferData(GL_PIXEL_PACK_BUFFER,tilesX*tilesY*4,0,GL_STREAM_READ);
+    glBindFramebuffer(GL_FRAMEBUFFER,fboTiles);
+    glPixelStorei(GL_PACK_ALIGNMENT,1);
+    glReadPixels(0,0,tilesX,tilesY,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    pending = true;
+    pendingTilesX = tilesX;
+    pendingTilesY = tilesY;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+#endif
+}
+
+// Depth values the incremental mode marks its tiles with: the NNF tiles
+// (changed tiles grown by the seed reach) at 0, the tiles that only need the
+// blended output refreshed (grown further by blendRadius) at 0.5, the rest
+// stays cleared to 1. The passes are then drawn at a depth in between with
+// GL_GREATER, so the early depth test rejects the unmarked tiles.
+static const float nnfTileDepth = 0.0f;
+static const float outputTileDepth = 0.5f;
+static const float mainPassDepth = 0.25f;
+static const float blendPassDepth = 0.75f;
+
+// Grows the tiles marked by diffTiles on the GPU and writes the depth marks
+// above into the depth buffer of fboOutput, all without a readback. Returns
+// an occlusion query that passes if any tile was marked at all, for skipping
+// the passes by conditional rendering, or 0 in the WebGL build, which has
+// neither.
+static GLuint markRefreshedTiles(int targetWidth,
+                               int targetHeight,
+                               int blendRadius,
+                               GLuint texTiles,
+                               GLuint fboOutput)
+{
+  static GLuint progGrow = 0;
+  static GLuint progMark = 0;
+  static GLuint texGrownTiles = 0;
+  static GLuint fboGrownTiles = 0;
+  static int grownTilesX = 0;
+  static int grownTilesY = 0;
+  static int oldBlendRadius = -1;
+  static GLuint queryMarked = 0;
+
+  const int tilesX = (targetWidth+tileSize-1)/tileSize;
+  const int tilesY = (targetHeight+tileSize-1)/tileSize;
+
+  if (progGrow==0 || blendRadius!=oldBlendRadius)
+  {
+    char growPrefix[256];
+    sprintf(growPrefix,"#define NNF_REACH %d\n#define OUTPUT_REACH %d\n",(seedReach+tileSize-1)/tileSize,(seedReach+blendRadius+tileSize-1)/tileSize);
+    if (progGrow!=0) { glDeleteProgram(progGrow); }
+    progGrow = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_grow.frag",growPrefix);
+    oldBlendRadius = blendRadius;
+  }
+
+  if (progMark==0)
+  {
+    char markPrefix[256];
+    sprintf(markPrefix,"#define TILE_SIZE %d\n",tileSize);
+    progMark = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_mark.frag",markPrefix);
+    texGrownTiles = createTexture2D(GL_RGBA,tilesX,tilesY,GL_NEAREST,GL_CLAMP_TO_EDGE);
+    fboGrownTiles = createFBO(texGrownTiles);
+    grownTilesX = tilesX;
+    grownTilesY = tilesY;
+  }
+
+  if (tilesX!=grownTilesX || tilesY!=grownTilesY)
+  {
+    glBindTexture(GL_TEXTURE_2D,texGrownTiles);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,tilesX,tilesY,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    grownTilesX = tilesX;
+    grownTilesY = tilesY;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER,fboGrownTiles);
+  glViewport(0,0,tilesX,tilesY);
+  glUseProgram(progGrow);
+  glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,texTiles);
+  glUniform1i(glGetUniformLocation(progGrow,"tiles"),0);
+  glUniform2f(glGetUniformLocation(progGrow,"tileCount"),tilesX,tilesY);
+  drawFullscreenTriangle(glGetAttribLocation(progGrow,"position"));
+
+  glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+  glViewport(0,0,targetWidth,targetHeight);
+  glEnable(GL_DEPTH_TEST);
+  glDepthMask(GL_TRUE);
+  glClearDepth(1.0);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  glDepthFunc(GL_ALWAYS);
+  glColorMask(GL_FALSE,GL_FALSE,GL_FALSE,GL_FALSE);
+
+  glUseProgram(progMark);
+  glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,texGrownTiles);
+  glUniform1i(glGetUniformLocation(progMark,"tiles"),0);
+  glUniform2f(glGetUniformLocation(progMark,"tileCount"),tilesX,tilesY);
+
+  // the output tiles include the NNF tiles, so they alone tell if any is marked
+  glDepthRange(outputTileDepth,outputTileDepth);
+  glUniform4f(glGetUniformLocation(progMark,"channel"),0.0f,1.0f,0.0f,0.0f);
+#ifndef __EMSCRIPTEN__
+  if (queryMarked==0) { glGenQueries(1,&queryMarked); }
+  glBeginQuery(GL_ANY_SAMPLES_PASSED,queryMarked);
+#endif
+  drawFullscreenTriangle(glGetAttribLocation(progMark,"position"));
+#ifndef __EMSCRIPTEN__
+  glEndQuery(GL_ANY_SAMPLES_PASSED);
+#endif
+
+  glDepthRange(nnfTileDepth,nnfTileDepth);
+  glUniform4f(glGetUniformLocation(progMark,"channel"),1.0f,0.0f,0.0f,0.0f);
+  drawFullscreenTriangle(glGetAttribLocation(progMark,"position"));
+
+  glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
+  glDepthMask(GL_FALSE);
+  glDepthFunc(GL_GREATER);
+
+  return queryMarked;
+}
+
+static void setupMainPass(GLuint prog,
+                          int targetWidth,
+                          int targetHeight,
+                          GLuint texTargetNormals,
+                          int sourceWidth,
+                          int sourceHeight,
+                          GLuint texSourceNormals,
+                          GLuint texSourceStyle,
+                          GLuint texJitterTable,
+                          GLuint texSourceLookup,
+                          float threshold,
+                          int targetOriginX,
+                          int targetOriginY)
+{
+  glViewport(0,0,targetWidth,targetHeight);
+  glUseProgram(prog);
+  glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,texTargetNormals);
+  glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D,texSourceNormals);
+  glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D,texJitterTable);
+  glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_2D,texSourceStyle);
+  glActiveTexture(GL_TEXTURE6); glBindTexture(GL_TEXTURE_2D,texSourceLookup);
+  glUniform1i(glGetUniformLocation(prog,"target"),0);
+  glUniform1i(glGetUniformLocation(prog,"source"),1);
+  glUniform1i(glGetUniformLocation(prog,"noise"),2);
+  glUniform1i(glGetUniformLocation(prog,"sourceStyle"),3);
+  glUniform1i(glGetUniformLocation(prog,"lookupTable"),6);
+  glUniform2f(glGetUniformLocation(prog,"targetSize"),targetWidth,targetHeight);
+  glUniform2f(glGetUniformLocation(prog,"sourceSize"),sourceWidth,sourceHeight);
+  glUniform1f(glGetUniformLocation(prog,"threshold"),threshold);
+  glUniform2f(glGetUniformLocation(prog,"targetOrigin"),targetOriginX,targetOriginY);
+}
+
+static void setupBlendPass(GLuint prog,
+                           int targetWidth,
+                           int targetHeight,
+                           GLuint texTargetNormals,
+                           int sourceWidth,
+                           int sourceHeight,
+                           GLuint texSourceStyle,
+                           GLuint texNNF)
+{
+  glViewport(0,0,targetWidth,targetHeight);
+  glUseProgram(prog);
+  glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,texNNF);
+  glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D,texSourceStyle);
+  glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D,texTargetNormals);
+  glUniform1i(glGetUniformLocation(prog,"NNF"),0);
+  glUniform1i(glGetUniformLocation(prog,"sourceStyle"),1);
+  glUniform1i(glGetUniformLocation(prog,"targetMask"),2);
+  glUniform2f(glGetUniformLocation(prog,"targetSize"),targetWidth,targetHeight);
+  glUniform2f(glGetUniformLocation(prog,"sourceSize"),sourceWidth,sourceHeight);
+}
+
+static void setupTemporalPass(GLuint prog,GLuint texPreviousNNF,GLuint texTargetMotion,bool historyValid)
+{
+  glActiveTexture(GL_TEXTURE4); glBindTexture(GL_TEXTURE_2D,texPreviousNNF);
+  glActiveTexture(GL_TEXTURE5); glBindTexture(GL_TEXTURE_2D,texTargetMotion);
+  glUniform1i(glGetUniformLocation(prog,"previousNNF"),4);
+  glUniform1i(glGetUniformLocation(prog,"motion"),5);
+  glUniform1f(glGetUniformLocation(prog,"historyValid"),historyValid ? 1.0f : 0.0f);
+}
+
+// Refresh order of the time-sliced mode: tiles where the guide changed first,
+// then the ones that have been waiting the longest.
+struct TileOrder
+{
+  const std::vector<unsigned char>* changedTiles;
+  const std::vector<int>* tileWaiting;
+
+  bool operator()(int a,int b) const
+  {
+    if ((*changedTiles)[a]!=(*changedTiles)[b]) { return (*changedTiles)[a]>(*changedTiles)[b]; }
+    if ((*tileWaiting)[a]!=(*tileWaiting)[b])   { return (*tileWaiting)[a]>(*tileWaiting)[b]; }
+    return a<b;
+  }
+};
+
+// The main pass programs (plain, fused and temporal) with the parameters that
+// are baked in as #defines. Compute variants only have progMain, a compute
+// program. Switching between a few configurations, e.g. the
+// source size snapping between the sizes of an asset pack, then only costs
+// the compilation the first time.
+struct MainPassVariant
+{
+  bool useLookup;
+  bool noJitter;
+  bool writeLevels;
+  bool adaptive;
+  bool compute;
+  int coarsestLevel;
+  int sourceWidth;   // 0 unless both sides are powers of two
+  int sourceHeight;
+  GLuint progMain;
+  GLuint progFused;
+  GLuint progTemporal;
+};
+
+static bool isPowerOfTwo(int x) { return x>0 && (x&(x-1))==0; }
+
+static const MainPassVariant& mainPassVariant(bool useLookup,bool noJitter,bool writeLevels,bool adaptive,bool compute,int coarsestLevel,int sourceWidth,int sourceHeight)
+{
+  static std::vector<MainPassVariant> variants;
+
+  // only power-of-two sizes are baked in, dividing by them stays exact when
+  // the compiler turns it into a multiplication
+  if (!isPowerOfTwo(sourceWidth) || !isPowerOfTwo(sourceHeight)) { sourceWidth = sourceHeight = 0; }
+
+  for(int i=0;i<variants.size();i++)
+  {
+    const MainPassVariant& v = variants[i];
+    if (v.useLookup==useLookup && v.noJitter==noJitter && v.writeLevels==writeLevels && v.adaptive==adaptive && v.compute==compute && v.coarsestLevel==coarsestLevel &&
+        v.sourceWidth==sourceWidth && v.sourceHeight==sourceHeight) { return v; }
+  }
+
+  char prefix[256];
+  int length = sprintf(prefix,"#define COARSEST_LEVEL %d\n",coarsestLevel);
+  if (useLookup)      { length += sprintf(prefix+length,"#define LOOKUP_TABLE\n"); }
+  if (noJitter)       { length += sprintf(prefix+length,"#define NO_JITTER\n"); }
+  if (writeLevels)    { length += sprintf(prefix+length,"#define WRITE_LEVELS\n"); }
+  if (adaptive)       { length += sprintf(prefix+length,"#define ADAPTIVE_LEVELS\n#define LEVEL_TILE_SIZE %d\n",levelTileSize); }
+  if (sourceWidth>0)  { length += sprintf(prefix+length,"#define SOURCE_SIZE vec2(%d.0,%d.0)\n",sourceWidth,sourceHeight); }
+
+  MainPassVariant v;
+  v.useLookup = useLookup;
+  v.noJitter = noJitter;
+  v.writeLevels = writeLevels;
+  v.adaptive = adaptive;
+  v.compute = compute;
+  v.coarsestLevel = coarsestLevel;
+  v.sourceWidth = sourceWidth;
+  v.sourceHeight = sourceHeight;
+
+  char variantPrefix[448];
+#if !defined(__EMSCRIPTEN__) && !defined(__APPLE__)
+  if (compute)
+  {
+    sprintf(variantPrefix,"#version 430\n#define COMPUTE\n#define GROUP_SIZE %d\n#define texture2D texture\n#define gl_FragColor fragColor\n#define gl_FragCoord fragCoord\n%s",computeGroupSize,prefix);
+    v.progMain = createComputeProgram("styleblit/styleblit_main.frag",variantPrefix);
+    v.progFused = 0;
+    v.progTemporal = 0;
+    variants.push_back(v);
+    return variants.back();
+  }
+#endif
+  v.progMain = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_main.frag",prefix);
+  sprintf(variantPrefix,"%s#define FUSED\n",prefix);
+  v.progFused = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_main.frag",variantPrefix);
+  sprintf(variantPrefix,"%s#define TEMPORAL\n",prefix);
+  v.progTemporal = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_main.frag",variantPrefix);
+
+  variants.push_back(v);
+  return variants.back();
+}
+
+#ifndef __EMSCRIPTEN__
+// The adaptive and the instrumented main pass write the level they accepted
+// for each pixel to a second color attachment of the NNF framebuffers.
+static void attachLevels(GLuint fbo,GLuint texLevels)
+{
+  const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0,GL_COLOR_ATTACHMENT1 };
+  glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT1,GL_TEXTURE_2D,texLevels,0);
+  glDrawBuffers(texLevels!=0 ? 2 : 1,drawBuffers);
+}
+#endif
+
+static void attachTileDepth(GLuint fbo,GLuint renderbuffer)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_RENDERBUFFER,renderbuffer);
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status!=GL_FRAMEBUFFER_COMPLETE) { printf("incomplete FBO!\n"); exit(1); }
+}
+
+static void drawImage(GLuint progCopy,GLuint texImage,int targetWidth,int targetHeight)
+{
+  glViewport(0,0,targetWidth,targetHeight);
+  glUseProgram(progCopy);
+  glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,texImage);
+  glUniform1i(glGetUniformLocation(progCopy,"image"),0);
+  glUniform2f(glGetUniformLocation(progCopy,"targetSize"),targetWidth,targetHeight);
+  drawFullscreenTriangle(glGetAttribLocation(progCopy,"position"));
+}
+
+static const int jitterTableWidth = 256;
+static const int jitterTableHeight = 256;
+
+static void randomizeJitterTable(GLuint texJitterTable)
+{
+  static unsigned char* jitterTableData = 0;
+  const int jitterTableSize = jitterTableWidth*jitterTableHeight*4;    
+  if (jitterTableData==0) { jitterTableData = new unsigned char[jitterTableSize]; }
+  for(int i=0;i<jitterTableSize;i++) { jitterTableData[i] = (float(rand())/float(RAND_MAX))*255.0f; }
+  
+  glBindTexture(GL_TEXTURE_2D,texJitterTable);
+  glTexSubImage2D(GL_TEXTURE_2D,0,0,0,jitterTableWidth,jitterTableHeight,GL_RGBA,GL_UNSIGNED_BYTE,jitterTableData);
+}
+
+static bool sourcesInvalidated = false;
+static GLuint lastNNF = 0;
+static GLuint lastLevels = 0;
+static int lastTargetWidth = 0;
+static int lastTargetHeight = 0;
+
+void styleblitInvalidate()
+{
+  sourcesInvalidated = true;
+}
+
+int styleblitTileHalo(int blendRadius)
+{
+  return seedReach+blendRadius;
+}
+
+GLuint styleblitNNF()
+{
+  return lastNNF;
+}
+
+#ifndef __EMSCRIPTEN__
+static int findChunk(std::vector<int>& parents,int i)
+{
+  while (parents[i]!=i) { parents[i] = parents[parents[i]]; i = parents[i]; }
+  return i;
+}
+
+bool styleblitStats(StyleblitStats* out_stats)
+{
+  if (lastLevels==0 || lastNNF==0) { return false; }
+
+  const int width = lastTargetWidth;
+  const int height = lastTargetHeight;
+  const int numPixels = width*height;
+
+  std::vector<unsigned char> levels(size_t(numPixels)*4);
+  std::vector<unsigned char> nnf(size_t(numPixels)*4);
+  glPixelStorei(GL_PACK_ALIGNMENT,1);
+  glBindTexture(GL_TEXTURE_2D,lastLevels);
+  glGetTexImage(GL_TEXTURE_2D,0,GL_RGBA,GL_UNSIGNED_BYTE,levels.data());
+  glBindTexture(GL_TEXTURE_2D,lastNNF);
+  glGetTexImage(GL_TEXTURE_2D,0,GL_RGBA,GL_UNSIGNED_BYTE,nnf.data());
+
+  StyleblitStats stats;
+  memset(&stats,0,sizeof(stats));
+
+  // chunks are the 4-connected regions of masked in pixels whose NNF entries
+  // are all offset from them the same way
+  std::vector<int> offsets(size_t(numPixels)*2);
+  std::vector<int> parents(numPixels);
+  for(int i=0;i<numPixels;i++)
+  {
+    const unsigned char* e = &nnf[size_t(i)*4];
+    offsets[i*2+0] = e[0]+e[1]*255-i%width;
+    offsets[i*2+1] = e[2]+e[3]*255-i/width;
+    parents[i] = i;
+  }
+
+  const auto maskedIn = [&](int i) { return levels[size_t(i)*4]!=255; };
+  const auto sameChunk = [&](int i,int j) { return maskedIn(j) && offsets[i*2]==offsets[j*2] && offsets[i*2+1]==offsets[j*2+1]; };
+
+  for(int y=0;y<height;y++)
+  for(int x=0;x<width;x++)
+  {
+    const int i = x+y*width;
+    if (!maskedIn(i)) { continue; }
+
+    const int level = levels[size_t(i)*4];
+    stats.numPixels++;
+    if      (level==0)   { stats.numFallbacks++; }
+    else if (level==254) { stats.numKept++; }
+    else if (level<=7)   { stats.levels[level-1]++; }
+
+    if (x>0 && sameChunk(i,i-1))      { parents[findChunk(parents,i)] = findChunk(parents,i-1); }
+    if (y>0 && sameChunk(i,i-width))  { parents[findChunk(parents,i)] = findChunk(parents,i-width); }
+  }
+
+  std::vector<int> chunkAreas(numPixels,0);
+  for(int i=0;i<numPixels;i++) { if (maskedIn(i)) { chunkAreas[findChunk(parents,i)]++; } }
+  for(int i=0;i<numPixels;i++)
+  {
+    if (chunkAreas[i]==0) { continue; }
+    int bin = 0;
+    while (bin<15 && (chunkAreas[i]>>(bin+1))>0) { bin++; }
+    stats.chunkSizes[bin]++;
+    stats.numChunks++;
+  }
+
+  *out_stats = stats;
+  return true;
+}
+
+static GLuint passQueries[3] = { 0,0,0 };
+static bool lastPassTimes = false;
+
+// Timestamps before the main pass, between the passes and after the blend
+// pass; the fused pass takes the last two at once.
+static void markPass(int flags,int mark)
+{
+  if (!(flags&STYLEBLIT_PASS_TIMES)) { return; }
+  if (passQueries[0]==0) { glGenQueries(3,passQueries); }
+  glQueryCounter(passQueries[mark],GL_TIMESTAMP);
+}
+
+bool styleblitPassTimes(float* out_mainMs,float* out_blendMs)
+{
+  if (!lastPassTimes) { return false; }
+
+  GLuint64 timestamps[3];
+  for(int i=0;i<3;i++) { glGetQueryObjectui64v(passQueries[i],GL_QUERY_RESULT,&timestamps[i]); }
+
+  *out_mainMs = float(double(timestamps[1]-timestamps[0])/1.0e6);
+  *out_blendMs = float(double(timestamps[2]-timestamps[1])/1.0e6);
+  return true;
+}
+#else
+static void markPass(int,int) { }
+#endif
+
+void styleblitBlend(int    targetWidth,
+                    int    targetHeight,
+                    GLuint texTargetMask,
+                    GLuint texNNF,
+                    int    sourceWidth,
+                    int    sourceHeight,
+                    GLuint texSourceStyle,
+                    int    blendRadius)
+{
+  static GLuint progBlend = 0;
+  static int oldBlendRadius = 0;
+
+  if (progBlend==0 || blendRadius!=oldBlendRadius)
+  {
+    char votePrefix[256];
+    sprintf(votePrefix,"#define BLEND_RADIUS %d\n",blendRadius);
+    if (progBlend!=0) { glDeleteProgram(progBlend); }
+    progBlend = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_blend.frag",votePrefix);
+    oldBlendRadius = blendRadius;
+  }
+
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_CULL_FACE);
+  setupBlendPass(progBlend,targetWidth,targetHeight,texTargetMask,sourceWidth,sourceHeight,texSourceStyle,texNNF);
+  drawFullscreenTriangle(glGetAttribLocation(progBlend,"position"));
+}
+
 void styleblit(int targetWidth,
                int targetHeight,
                GLuint texTargetNormals,
@@ -153,16 +913,29 @@ void styleblit(int targetWidth,
                GLuint texSourceStyle,
                float threshold,
                int blendRadius,
-               bool jitter)
+               bool jitter,
+               int flags,
+               GLuint texTargetMotion,
+               int tileBudget,
+               GLuint texSourceLookup,
+               int targetOriginX,
+               int targetOriginY)
 {
+  GLint outputFramebuffer = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING,&outputFramebuffer);
+
   static GLuint progMain = 0;
   static GLuint progBlend = 0;
+  static GLuint progFused = 0;
+  static GLuint progTemporal = 0;
+  static GLuint progCopy = 0;
   static GLuint texNNF = 0;
   static GLuint fboNNF = 0;
+  static GLuint texPreviousNNF = 0;
+  static GLuint fboPreviousNNF = 0;
+  static GLuint rboTileDepth = 0;
+  static bool historyValid = false;
   static GLuint texJitterTable = 0;
-  const int jitterTableWidth = 256;
-  const int jitterTableHeight = 256;
-  static unsigned char* jitterTableData = 0;
   static int oldTargetWidth = 0;
   static int oldTargetHeight = 0;
   static int oldBlendRadius = 0;
@@ -170,7 +943,6 @@ void styleblit(int targetWidth,
 
   if (!initialized)
   {
-    progMain = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_main.frag");
     texNNF  = createTexture2D(GL_RGBA,targetWidth,targetHeight,GL_NEAREST,GL_CLAMP_TO_EDGE);
     fboNNF  = createFBO(texNNF);
     texJitterTable = createTexture2D(GL_RGBA,jitterTableWidth,jitterTableHeight,GL_NEAREST,GL_REPEAT);
@@ -178,6 +950,8 @@ void styleblit(int targetWidth,
     initialized = true;
   }
 
+  bool settingsChanged = false;
+
   if (progBlend==0 || blendRadius!=oldBlendRadius)
   {
     char votePrefix[256];
@@ -185,59 +959,645 @@ void styleblit(int targetWidth,
     if (progBlend!=0) { glDeleteProgram(progBlend); }
     progBlend = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_blend.frag",votePrefix);
     oldBlendRadius = blendRadius;
+    settingsChanged = true;
+  }
+
+  const int coarsestLevel = (flags&STYLEBLIT_COARSEST_LEVEL_MASK) ? ((flags&STYLEBLIT_COARSEST_LEVEL_MASK)>>8)-1 : 6;
+#ifndef __EMSCRIPTEN__
+  const bool adaptive = (flags&STYLEBLIT_ADAPTIVE_LEVELS)!=0;
+  const bool writeLevels = adaptive || (flags&STYLEBLIT_LEVEL_STATS)!=0;
+#else
+  const bool adaptive = false;
+  const bool writeLevels = false;
+#endif
+#if !defined(__EMSCRIPTEN__) && !defined(__APPLE__)
+  const bool compute = (flags&STYLEBLIT_COMPUTE) && !writeLevels && tileBudget<=0 &&
+                       !(flags&STYLEBLIT_INCREMENTAL) && !((flags&STYLEBLIT_TEMPORAL) && texTargetMotion!=0) &&
+                       computeSupported() && computeTileFits(blendRadius);
+#else
+  const bool compute = false;
+#endif
+  const MainPassVariant& variant = mainPassVariant(texSourceLookup!=0,(flags&STYLEBLIT_NO_JITTER)!=0,writeLevels,adaptive,compute,std::min(coarsestLevel,6),sourceWidth,sourceHeight);
+
+  if (variant.progMain!=progMain)
+  {
+    progMain = variant.progMain;
+    progFused = variant.progFused;
+    progTemporal = variant.progTemporal;
+    settingsChanged = true;
   }
 
   if (targetWidth!=oldTargetWidth || targetHeight!=oldTargetHeight)
   {
     glBindTexture(GL_TEXTURE_2D,texNNF);
     glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,targetWidth,targetHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    if (texPreviousNNF!=0)
+    {
+      glBindTexture(GL_TEXTURE_2D,texPreviousNNF);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,targetWidth,targetHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    }
+    // attached to the NNF targets, so it has to follow their size
+    if (rboTileDepth!=0)
+    {
+      glBindRenderbuffer(GL_RENDERBUFFER,rboTileDepth);
+      glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH_COMPONENT16,targetWidth,targetHeight);
+    }
 
     oldTargetWidth  = targetWidth;
     oldTargetHeight = targetHeight;
+    settingsChanged = true;
   }
 
-  if (jitter)
-  {
-    const int jitterTableSize = jitterTableWidth*jitterTableHeight*4;    
-    if (jitterTableData==0) { jitterTableData = new unsigned char[jitterTableSize]; }
-    for(int i=0;i<jitterTableSize;i++) { jitterTableData[i] = (float(rand())/float(RAND_MAX))*255.0f; }
-    
-    glBindTexture(GL_TEXTURE_2D,texJitterTable);
-    glTexSubImage2D(GL_TEXTURE_2D,0,0,0,jitterTableWidth,jitterTableHeight,GL_RGBA,GL_UNSIGNED_BYTE,jitterTableData);
-  }
+  if (jitter) { randomizeJitterTable(texJitterTable); }
+
+  static GLuint oldTexSourceNormals = 0;
+  static GLuint oldTexSourceStyle = 0;
+  static int oldSourceWidth = 0;
+  static int oldSourceHeight = 0;
+  static float oldThreshold = 0;
+  static GLuint oldTexSourceLookup = 0;
+  static int oldTargetOriginX = 0;
+  static int oldTargetOriginY = 0;
+
+  // the seeds are laid out relative to the origin, so moving it moves them all
+  const bool inputsChanged = (sourcesInvalidated ||
+                              texSourceNormals!=oldTexSourceNormals ||
+                              texSourceStyle!=oldTexSourceStyle ||
+                              sourceWidth!=oldSourceWidth ||
+                              sourceHeight!=oldSourceHeight ||
+                              threshold!=oldThreshold ||
+                              texSourceLookup!=oldTexSourceLookup ||
+                              targetOriginX!=oldTargetOriginX ||
+                              targetOriginY!=oldTargetOriginY);
+
+  sourcesInvalidated = false;
+  oldTexSourceNormals = texSourceNormals;
+  oldTexSourceStyle = texSourceStyle;
+  oldSourceWidth = sourceWidth;
+  oldSourceHeight = sourceHeight;
+  oldThreshold = threshold;
+  oldTexSourceLookup = texSourceLookup;
+  oldTargetOriginX = targetOriginX;
+  oldTargetOriginY = targetOriginY;
 
   glDisable(GL_DEPTH_TEST);
   glDisable(GL_CULL_FACE);
 
-  ///////////////////////////////////////////////////////////////////////////
+#ifndef __EMSCRIPTEN__
+  lastPassTimes = (flags&STYLEBLIT_PASS_TIMES)!=0;
+#endif
+  markPass(flags,0);
 
-  glBindFramebuffer(GL_FRAMEBUFFER,fboNNF);
-  glViewport(0,0,targetWidth,targetHeight);
-  glUseProgram(progMain);
-  glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,texTargetNormals);
-  glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D,texSourceNormals);
-  glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D,texJitterTable);
-  glUniform1i(glGetUniformLocation(progMain,"target"),0);
-  glUniform1i(glGetUniformLocation(progMain,"source"),1);
-  glUniform1i(glGetUniformLocation(progMain,"noise"),2);
-  glUniform2f(glGetUniformLocation(progMain,"targetSize"),targetWidth,targetHeight);
-  glUniform2f(glGetUniformLocation(progMain,"sourceSize"),sourceWidth,sourceHeight);
-  glUniform1f(glGetUniformLocation(progMain,"threshold"),threshold);
-  drawFullscreenTriangle(glGetAttribLocation(progMain,"position"));
+  // the fused pass never writes the NNF, so switching to it and back leaves
+  // the kept NNF stale
+  static bool oldFused = false;
+  const bool fused = (blendRadius==0) && !(flags&STYLEBLIT_KEEP_NNF) && !writeLevels;
+  if (fused!=oldFused) { settingsChanged = true; oldFused = fused; }
+
+#ifndef __EMSCRIPTEN__
+  static GLuint progLevels = 0;
+  static GLuint texLevels = 0;
+  static GLuint texStartLevels = 0;
+  static GLuint fboStartLevels = 0;
+  static int levelsWidth = 0;
+  static int levelsHeight = 0;
+  static int startLevelTilesX = 0;
+  static int startLevelTilesY = 0;
+  static bool levelsWritten = false;
+  static bool levelsAttached = false;
+
+  const int levelTilesX = (targetWidth+levelTileSize-1)/levelTileSize;
+  const int levelTilesY = (targetHeight+levelTileSize-1)/levelTileSize;
+
+  if (writeLevels && texLevels==0)
+  {
+    texLevels = createTexture2D(GL_RGBA,targetWidth,targetHeight,GL_NEAREST,GL_CLAMP_TO_EDGE);
+    levelsWidth = targetWidth;
+    levelsHeight = targetHeight;
+  }
+
+  if (adaptive && progLevels==0)
+  {
+    char levelsPrefix[256];
+    sprintf(levelsPrefix,"#define TILE_SIZE %d\n",levelTileSize);
+    progLevels = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_levels.frag",levelsPrefix);
+    texStartLevels = createTexture2D(GL_RGBA,levelTilesX,levelTilesY,GL_NEAREST,GL_CLAMP_TO_EDGE);
+    fboStartLevels = createFBO(texStartLevels);
+    startLevelTilesX = levelTilesX;
+    startLevelTilesY = levelTilesY;
+  }
+
+  if (writeLevels && (targetWidth!=levelsWidth || targetHeight!=levelsHeight))
+  {
+    glBindTexture(GL_TEXTURE_2D,texLevels);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,targetWidth,targetHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    levelsWidth = targetWidth;
+    levelsHeight = targetHeight;
+    levelsWritten = false;
+  }
+
+  if (adaptive)
+  {
+    if (levelTilesX!=startLevelTilesX || levelTilesY!=startLevelTilesY)
+    {
+      glBindTexture(GL_TEXTURE_2D,texStartLevels);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,levelTilesX,levelTilesY,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+      startLevelTilesX = levelTilesX;
+      startLevelTilesY = levelTilesY;
+    }
+
+    // the levels of the previous call only say something about this one when
+    // the seeds were searched the same way and against the same source
+    const bool startLevelsValid = levelsWritten && !settingsChanged && !inputsChanged;
+    if (startLevelsValid)
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER,fboStartLevels);
+      glViewport(0,0,levelTilesX,levelTilesY);
+      glUseProgram(progLevels);
+      glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,texLevels);
+      glUniform1i(glGetUniformLocation(progLevels,"levels"),0);
+      glUniform2f(glGetUniformLocation(progLevels,"targetSize"),targetWidth,targetHeight);
+      glUniform1f(glGetUniformLocation(progLevels,"coarsestLevel"),std::min(coarsestLevel,6));
+      drawFullscreenTriangle(glGetAttribLocation(progLevels,"position"));
+    }
+
+    const GLuint adaptivePrograms[] = { progMain,progTemporal };
+    for(int i=0;i<2;i++)
+    {
+      glUseProgram(adaptivePrograms[i]);
+      glUniform1i(glGetUniformLocation(adaptivePrograms[i],"startLevels"),7);
+      glUniform2f(glGetUniformLocation(adaptivePrograms[i],"levelTiles"),levelTilesX,levelTilesY);
+      glUniform1f(glGetUniformLocation(adaptivePrograms[i],"startLevelsValid"),startLevelsValid ? 1.0f : 0.0f);
+    }
+    glActiveTexture(GL_TEXTURE7); glBindTexture(GL_TEXTURE_2D,texStartLevels);
+  }
+  levelsWritten = writeLevels;
+
+  if (writeLevels!=levelsAttached)
+  {
+    attachLevels(fboNNF,writeLevels ? texLevels : 0);
+    if (fboPreviousNNF!=0) { attachLevels(fboPreviousNNF,writeLevels ? texLevels : 0); }
+    levelsAttached = writeLevels;
+  }
+  lastLevels = writeLevels ? texLevels : 0;
+#endif
+  lastTargetWidth = targetWidth;
+  lastTargetHeight = targetHeight;
+
+  if (tileBudget>0)
+  {
+    ///////////////////////////////////////////////////////////////////////////
+    // Time-sliced mode: the NNF is kept between calls and at most tileBudget
+    // of its tiles are re-searched per call, so after a jitter tick the
+    // refresh sweeps over the frame in several calls.
+
+    static std::vector<int> tileWaiting;
+    static int slicedWidth = 0;
+    static int slicedHeight = 0;
+
+    const int tilesX = (targetWidth+tileSize-1)/tileSize;
+    const int tilesY = (targetHeight+tileSize-1)/tileSize;
+    const int numTiles = tilesX*tilesY;
+
+    // the contents of a freshly (re)allocated NNF are undefined, so that one
+    // time the whole NNF is searched regardless of the budget
+    const bool undefinedNNF = (targetWidth!=slicedWidth || targetHeight!=slicedHeight);
+    slicedWidth = targetWidth;
+    slicedHeight = targetHeight;
+
+    // tiles searched with other settings or inputs are all waiting again
+    GLuint texTiles = 0;
+    GLuint fboTiles = 0;
+    const bool compared = diffTiles(targetWidth,targetHeight,texTargetNormals,!(undefinedNNF || jitter || settingsChanged || inputsChanged),&texTiles,&fboTiles);
+
+    std::vector<unsigned char> changedTiles;
+    readChangedTiles(tilesX,tilesY,compared,fboTiles,&changedTiles);
+
+    std::vector<unsigned char> affectedTiles;
+    growTiles(changedTiles,tilesX,tilesY,(seedReach+tileSize-1)/tileSize,&affectedTiles);
+
+    if (int(tileWaiting.size())!=numTiles) { tileWaiting.assign(numTiles,0); }
+
+    std::vector<int> waitingTiles;
+    for(int i=0;i<numTiles;i++)
+    {
+      if (tileWaiting[i]>0)    { tileWaiting[i]++; }
+      else if (affectedTiles[i]) { tileWaiting[i] = 1; }
+      if (tileWaiting[i]>0) { waitingTiles.push_back(i); }
+    }
+
+    const int numRefreshed = undefinedNNF ? int(waitingTiles.size()) : std::min(tileBudget,int(waitingTiles.size()));
+
+    TileOrder tileOrder = { &changedTiles, &tileWaiting };
+    std::partial_sort(waitingTiles.begin(),waitingTiles.begin()+numRefreshed,waitingTiles.end(),tileOrder);
+
+    std::vector<unsigned char> refreshedTiles(numTiles,0);
+    for(int i=0;i<numRefreshed;i++)
+    {
+      refreshedTiles[waitingTiles[i]] = 1;
+      tileWaiting[waitingTiles[i]] = 0;
+    }
+
+    if (numRefreshed>0)
+    {
+      std::vector<int> rects;
+      tilesToRects(refreshedTiles,tilesX,tilesY,targetWidth,targetHeight,&rects);
+
+      glBindFramebuffer(GL_FRAMEBUFFER,fboNNF);
+      setupMainPass(progMain,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,targetOriginX,targetOriginY);
+      drawRects(glGetAttribLocation(progMain,"position"),rects,targetWidth,targetHeight);
+    }
+    markPass(flags,1);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,outputFramebuffer);
+    glEnable(GL_DEPTH_TEST);
+    setupBlendPass(progBlend,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceStyle,texNNF);
+    drawFullscreenTriangle(glGetAttribLocation(progBlend,"position"));
+    markPass(flags,2);
+    lastNNF = texNNF;
+    return;
+  }
+
+  // The reprojected NNF is only meaningful while the seeds, the target size
+  // and the source coordinate frame stay the same as in the previous call.
+  const bool temporal = (flags&STYLEBLIT_TEMPORAL) && texTargetMotion!=0;
+  if (!temporal || jitter || settingsChanged || inputsChanged) { historyValid = false; }
+
+  if (temporal && texPreviousNNF==0)
+  {
+    texPreviousNNF = createTexture2D(GL_RGBA,targetWidth,targetHeight,GL_NEAREST,GL_CLAMP_TO_EDGE);
+    fboPreviousNNF = createFBO(texPreviousNNF);
+#ifndef __EMSCRIPTEN__
+    if (writeLevels) { attachLevels(fboPreviousNNF,texLevels); }
+#endif
+  }
+
+  if (temporal && !(flags&STYLEBLIT_INCREMENTAL))
+  {
+    std::swap(texNNF,texPreviousNNF);
+    std::swap(fboNNF,fboPreviousNNF);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,fboNNF);
+    setupMainPass(progTemporal,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,targetOriginX,targetOriginY);
+    setupTemporalPass(progTemporal,texPreviousNNF,texTargetMotion,historyValid);
+    drawFullscreenTriangle(glGetAttribLocation(progTemporal,"position"));
+    historyValid = true;
+    markPass(flags,1);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,outputFramebuffer);
+    glEnable(GL_DEPTH_TEST);
+    setupBlendPass(progBlend,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceStyle,texNNF);
+    drawFullscreenTriangle(glGetAttribLocation(progBlend,"position"));
+    markPass(flags,2);
+    lastNNF = texNNF;
+    return;
+  }
+
+#if !defined(__EMSCRIPTEN__) && !defined(__APPLE__)
+  if (compute)
+  {
+    // Both passes as compute dispatches writing RGBA8 images. The blend pass
+    // votes from tiles of the NNF staged in shared memory (see
+    // styleblit_blend.comp) and its image is then copied to the output.
+    static GLuint progBlendCompute = 0;
+    static int computeBlendRadius = 0;
+    static GLuint texComputeNNF = 0;
+    static GLuint texComputeOutput = 0;
+    static int computeWidth = 0;
+    static int computeHeight = 0;
+
+    if (progBlendCompute==0 || blendRadius!=computeBlendRadius)
+    {
+      char blendPrefix[256];
+      sprintf(blendPrefix,"#version 430\n#define BLEND_RADIUS %d\n#define TILE_SIZE %d\n",blendRadius,computeTileSize);
+      if (progBlendCompute!=0) { glDeleteProgram(progBlendCompute); }
+      progBlendCompute = createComputeProgram("styleblit/styleblit_blend.comp",blendPrefix);
+      computeBlendRadius = blendRadius;
+    }
+
+    if (progCopy==0) { progCopy = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_copy.frag"); }
+
+    // image load/store needs sized formats, hence no createTexture2D here
+    if (texComputeNNF==0 || targetWidth!=computeWidth || targetHeight!=computeHeight)
+    {
+      if (texComputeNNF==0)
+      {
+        texComputeNNF = createTexture2D(GL_RGBA,targetWidth,targetHeight,GL_NEAREST,GL_CLAMP_TO_EDGE);
+        texComputeOutput = createTexture2D(GL_RGBA,targetWidth,targetHeight,GL_NEAREST,GL_CLAMP_TO_EDGE);
+      }
+      glBindTexture(GL_TEXTURE_2D,texComputeNNF);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,targetWidth,targetHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+      glBindTexture(GL_TEXTURE_2D,texComputeOutput);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,targetWidth,targetHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+      computeWidth = targetWidth;
+      computeHeight = targetHeight;
+    }
+
+    setupMainPass(progMain,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,targetOriginX,targetOriginY);
+    glBindImageTexture(0,texComputeNNF,0,GL_FALSE,0,GL_WRITE_ONLY,GL_RGBA8);
+    glUniform1i(glGetUniformLocation(progMain,"outputImage"),0);
+    glDispatchCompute((targetWidth+computeGroupSize-1)/computeGroupSize,(targetHeight+computeGroupSize-1)/computeGroupSize,1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    markPass(flags,1);
+
+    setupBlendPass(progBlendCompute,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceStyle,texComputeNNF);
+    glBindImageTexture(0,texComputeOutput,0,GL_FALSE,0,GL_WRITE_ONLY,GL_RGBA8);
+    glUniform1i(glGetUniformLocation(progBlendCompute,"outputImage"),0);
+    glDispatchCompute((targetWidth+computeTileSize-1)/computeTileSize,(targetHeight+computeTileSize-1)/computeTileSize,1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT|GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,outputFramebuffer);
+    glEnable(GL_DEPTH_TEST);
+    drawImage(progCopy,texComputeOutput,targetWidth,targetHeight);
+    markPass(flags,2);
+    lastNNF = texComputeNNF;
+    return;
+  }
+#endif
+
+  if (!(flags&STYLEBLIT_INCREMENTAL))
+  {
+    if (fused)
+    {
+      // Without blending every pixel looks up the NNF exactly once, so the main
+      // pass can fetch the style itself and skip the NNF target and blend pass.
+      glBindFramebuffer(GL_FRAMEBUFFER,outputFramebuffer);
+      glEnable(GL_DEPTH_TEST);
+      setupMainPass(progFused,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,targetOriginX,targetOriginY);
+      drawFullscreenTriangle(glGetAttribLocation(progFused,"position"));
+      markPass(flags,1);
+      markPass(flags,2);
+      lastNNF = 0;
+      return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER,fboNNF);
+    setupMainPass(progMain,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,targetOriginX,targetOriginY);
+    drawFullscreenTriangle(glGetAttribLocation(progMain,"position"));
+    markPass(flags,1);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,outputFramebuffer);
+    glEnable(GL_DEPTH_TEST);
+    setupBlendPass(progBlend,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceStyle,texNNF);
+    drawFullscreenTriangle(glGetAttribLocation(progBlend,"position"));
+    markPass(flags,2);
+    lastNNF = texNNF;
+    return;
+  }
 
   ///////////////////////////////////////////////////////////////////////////
+  // Incremental mode: the stylized result is kept in texOutput between calls
+  // and only the tiles where the target guide changed since the previous call
+  // are re-stylized, grown by the seed reach for the NNF and by the seed reach
+  // plus blendRadius for the blended output. The tiles are selected on the GPU
+  // by depth marks (see markRefreshedTiles), so nothing is read back. When no
+  // tile changed at all, the passes are skipped and the kept result is only
+  // presented again.
+
+  static GLuint texOutput = 0;
+  static GLuint fboOutput = 0;
+  static GLuint fboTileDepth = 0;
+  static int outputWidth = 0;
+  static int outputHeight = 0;
+  static bool outputValid = false;
+
+  if (progCopy==0) { progCopy = createProgram("styleblit/styleblit_pass.vert","styleblit/styleblit_copy.frag"); }
+
+  if (texOutput==0)
+  {
+    texOutput = createTexture2D(GL_RGBA,targetWidth,targetHeight,GL_NEAREST,GL_CLAMP_TO_EDGE);
+    fboOutput = createFBO(texOutput);
+    glGenRenderbuffers(1,&rboTileDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER,rboTileDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH_COMPONENT16,targetWidth,targetHeight);
+    attachTileDepth(fboOutput,rboTileDepth);
+    outputWidth = targetWidth;
+    outputHeight = targetHeight;
+  }
+
+  if (targetWidth!=outputWidth || targetHeight!=outputHeight)
+  {
+    glBindTexture(GL_TEXTURE_2D,texOutput);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,targetWidth,targetHeight,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    outputWidth = targetWidth;
+    outputHeight = targetHeight;
+    outputValid = false;
+  }
+
+  const bool fullRefresh = (!outputValid ||
+                            settingsChanged ||
+                            jitter ||
+                            inputsChanged);
+
+  GLuint texTiles = 0;
+  GLuint fboTiles = 0;
+  const bool masked = diffTiles(targetWidth,targetHeight,texTargetNormals,!fullRefresh && !temporal,&texTiles,&fboTiles);
+
+  GLuint queryMarked = 0;
+  bool unchanged = false;
+  if (masked)
+  {
+    // the NNF target swaps with the previous one in the temporal mode, so it
+    // gets the shared depth buffer whenever it's a different one
+    if (fboTileDepth!=fboNNF) { attachTileDepth(fboNNF,rboTileDepth); fboTileDepth = fboNNF; }
+    queryMarked = markRefreshedTiles(targetWidth,targetHeight,blendRadius,texTiles,fboOutput);
+#ifdef __EMSCRIPTEN__
+    // no conditional rendering in WebGL 1, the few tile texels are read instead
+    std::vector<unsigned char> changedTiles;
+    readChangedTiles((targetWidth+tileSize-1)/tileSize,(targetHeight+tileSize-1)/tileSize,true,fboTiles,&changedTiles);
+    unchanged = std::find(changedTiles.begin(),changedTiles.end(),1)==changedTiles.end();
+#endif
+  }
+
+#ifndef __EMSCRIPTEN__
+  if (queryMarked!=0) { glBeginConditionalRender(queryMarked,GL_QUERY_WAIT); }
+#endif
+
+  if (unchanged)
+  {
+    // nothing to re-stylize, texOutput is presented as it is
+  }
+  else if (temporal)
+  {
+    // The reprojection moves NNF entries across the whole frame, so in the
+    // temporal mode both passes always cover all of it.
+    std::swap(texNNF,texPreviousNNF);
+    std::swap(fboNNF,fboPreviousNNF);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,fboNNF);
+    setupMainPass(progTemporal,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,targetOriginX,targetOriginY);
+    setupTemporalPass(progTemporal,texPreviousNNF,texTargetMotion,historyValid);
+    drawFullscreenTriangle(glGetAttribLocation(progTemporal,"position"));
+    historyValid = true;
+    markPass(flags,1);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+    setupBlendPass(progBlend,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceStyle,texNNF);
+    drawFullscreenTriangle(glGetAttribLocation(progBlend,"position"));
+  }
+  else if (fused)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+    if (masked) { glDepthRange(mainPassDepth,mainPassDepth); }
+    setupMainPass(progFused,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,targetOriginX,targetOriginY);
+    drawFullscreenTriangle(glGetAttribLocation(progFused,"position"));
+    markPass(flags,1);
+  }
+  else
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER,fboNNF);
+    if (masked) { glDepthRange(mainPassDepth,mainPassDepth); }
+    setupMainPass(progMain,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,targetOriginX,targetOriginY);
+    drawFullscreenTriangle(glGetAttribLocation(progMain,"position"));
+    markPass(flags,1);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+    if (masked) { glDepthRange(blendPassDepth,blendPassDepth); }
+    setupBlendPass(progBlend,targetWidth,targetHeight,texTargetNormals,sourceWidth,sourceHeight,texSourceStyle,texNNF);
+    drawFullscreenTriangle(glGetAttribLocation(progBlend,"position"));
+  }
+
+#ifndef __EMSCRIPTEN__
+  if (queryMarked!=0) { glEndConditionalRender(); }
+#endif
+
+  if (masked)
+  {
+    glDepthRange(0.0,1.0);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
+  }
 
-  glBindFramebuffer(GL_FRAMEBUFFER,0);
+  outputValid = true;
+  lastNNF = (fused && !temporal) ? 0 : texNNF;
+
+  glBindFramebuffer(GL_FRAMEBUFFER,outputFramebuffer);
   glEnable(GL_DEPTH_TEST);
-  glViewport(0,0,targetWidth,targetHeight);
-  glUseProgram(progBlend);
-  glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,texNNF);
-  glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D,texSourceStyle);
-  glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D,texTargetNormals);
-  glUniform1i(glGetUniformLocation(progBlend,"NNF"),0);
-  glUniform1i(glGetUniformLocation(progBlend,"sourceStyle"),1);
-  glUniform1i(glGetUniformLocation(progBlend,"targetMask"),2);
-  glUniform2f(glGetUniformLocation(progBlend,"targetSize"),targetWidth,targetHeight);
-  glUniform2f(glGetUniformLocation(progBlend,"sourceSize"),sourceWidth,sourceHeight);
-  drawFullscreenTriangle(glGetAttribLocation(progBlend,"position"));
+  drawImage(progCopy,texOutput,targetWidth,targetHeight);
+  markPass(flags,2);
+}
+
+#ifndef __EMSCRIPTEN__
+static void attachLayers(GLuint fbo,GLuint textureArray)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+  glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,textureArray,0);
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status!=GL_FRAMEBUFFER_COMPLETE) { printf("incomplete FBO!\n"); exit(1); }
+}
+
+void styleblitLayers(int    targetWidth,
+                     int    targetHeight,
+                     int    numLayers,
+                     GLuint texTargetNormals,
+                     int    sourceWidth,
+                     int    sourceHeight,
+                     GLuint texSourceNormals,
+                     GLuint texSourceStyle,
+                     float  threshold,
+                     int    blendRadius,
+                     bool   jitter,
+                     GLuint texOutput,
+                     GLuint texSourceLookup)
+{
+  GLint outputFramebuffer = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING,&outputFramebuffer);
+
+  static GLuint progMain = 0;
+  static GLuint progFused = 0;
+  static GLuint progBlend = 0;
+  static GLuint texNNF = 0;
+  static GLuint fboNNF = 0;
+  static GLuint fboOutput = 0;
+  static GLuint texJitterTable = 0;
+  static int oldTargetWidth = 0;
+  static int oldTargetHeight = 0;
+  static int oldNumLayers = 0;
+  static int oldBlendRadius = 0;
+  static bool oldUseLookup = false;
+
+  // the shaders are shared with the single-view passes, GLSL 1.50 only adds
+  // the array samplers and the layer routing
+  const char* layeredPrefix = "#version 150\n"
+                              "#define LAYERED\n"
+                              "#define texture2D texture\n"
+                              "#define gl_FragColor fragColor\n"
+                              "out vec4 fragColor;\n";
+
+  if (texJitterTable==0)
+  {
+    texJitterTable = createTexture2D(GL_RGBA,jitterTableWidth,jitterTableHeight,GL_NEAREST,GL_REPEAT);
+    glGenTextures(1,&texNNF);
+    glGenFramebuffers(1,&fboNNF);
+    glGenFramebuffers(1,&fboOutput);
+    jitter = true;
+  }
+
+  if (progBlend==0 || blendRadius!=oldBlendRadius)
+  {
+    char blendPrefix[256];
+    sprintf(blendPrefix,"%s#define BLEND_RADIUS %d\n",layeredPrefix,blendRadius);
+    if (progBlend!=0) { glDeleteProgram(progBlend); }
+    progBlend = createProgram("styleblit/styleblit_layered.vert","styleblit/styleblit_blend.frag",blendPrefix,"styleblit/styleblit_layered.geom");
+    oldBlendRadius = blendRadius;
+  }
+
+  const bool useLookup = (texSourceLookup!=0);
+
+  if (progMain==0 || useLookup!=oldUseLookup)
+  {
+    const char* lookupPrefix = useLookup ? "#define LOOKUP_TABLE\n" : "";
+    char mainPrefix[256];
+    if (progMain!=0) { glDeleteProgram(progMain); glDeleteProgram(progFused); }
+    sprintf(mainPrefix,"%s%s",layeredPrefix,lookupPrefix);
+    progMain = createProgram("styleblit/styleblit_layered.vert","styleblit/styleblit_main.frag",mainPrefix,"styleblit/styleblit_layered.geom");
+    sprintf(mainPrefix,"%s%s#define FUSED\n",layeredPrefix,lookupPrefix);
+    progFused = createProgram("styleblit/styleblit_layered.vert","styleblit/styleblit_main.frag",mainPrefix,"styleblit/styleblit_layered.geom");
+    oldUseLookup = useLookup;
+  }
+
+  if (targetWidth!=oldTargetWidth || targetHeight!=oldTargetHeight || numLayers!=oldNumLayers)
+  {
+    glBindTexture(GL_TEXTURE_2D_ARRAY,texNNF);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY,0,GL_RGBA,targetWidth,targetHeight,numLayers,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY,0);
+    attachLayers(fboNNF,texNNF);
+    oldTargetWidth = targetWidth;
+    oldTargetHeight = targetHeight;
+    oldNumLayers = numLayers;
+  }
+
+  if (jitter) { randomizeJitterTable(texJitterTable); }
+
+  // the array textures go to the units the 2D ones would be bound to
+  if (blendRadius==0)
+  {
+    attachLayers(fboOutput,texOutput);
+    setupMainPass(progFused,targetWidth,targetHeight,0,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,0,0);
+    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D_ARRAY,texTargetNormals);
+    drawFullscreenTriangle(glGetAttribLocation(progFused,"position"),numLayers);
+  }
+  else
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER,fboNNF);
+    setupMainPass(progMain,targetWidth,targetHeight,0,sourceWidth,sourceHeight,texSourceNormals,texSourceStyle,texJitterTable,texSourceLookup,threshold,0,0);
+    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D_ARRAY,texTargetNormals);
+    drawFullscreenTriangle(glGetAttribLocation(progMain,"position"),numLayers);
+
+    attachLayers(fboOutput,texOutput);
+    setupBlendPass(progBlend,targetWidth,targetHeight,0,sourceWidth,sourceHeight,texSourceStyle,0);
+    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D_ARRAY,texNNF);
+    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D_ARRAY,texTargetNormals);
+    drawFullscreenTriangle(glGetAttribLocation(progBlend,"position"),numLayers);
+  }
+
+  glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D_ARRAY,0);
+  glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D_ARRAY,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,outputFramebuffer);
 }
+#endif
@@ -11,6 +11,96 @@
 #include <GL/glew.h>
 #endif
 
+// Keep the stylized result between calls and re-stylize only the tiles where
+// the target guide changed, unless a jitter, parameter or source change forces
+// a full refresh. The tiles are selected on the GPU; when none changed, the
+// passes are skipped by conditional rendering (in the WebGL build, after
+// reading the tiles back) and the kept result is drawn again. Together with
+// STYLEBLIT_TEMPORAL both passes cover the whole frame, so the combination
+// only adds the tile selection and a copy of the kept result; use one or the
+// other.
+#define STYLEBLIT_INCREMENTAL 0x0001
+
+// Reproject the previous frame's NNF along texTargetMotion and run the seed
+// search only where the reprojected entry fails the threshold, so chunks stick
+// to the surface between jitter ticks. texTargetMotion holds the per-pixel
+// screen-space motion (current minus previous position, in pixels) offset by
+// 32768 and stored as two 16-bit numbers in the NNF layout (r+g*255,b+a*255).
+#define STYLEBLIT_TEMPORAL    0x0002
+
+// Write the NNF even when blendRadius is 0, where the main pass otherwise
+// looks up the style directly and the NNF is never stored, so that
+// styleblitNNF() has something to return.
+#define STYLEBLIT_KEEP_NNF    0x0004
+
+// Place the seeds on a regular grid instead of jittering them. The nearest
+// seed is then computed directly rather than searched for among nine fetched
+// from the jitter table, which makes the main pass much cheaper at the cost
+// of grid-aligned chunks. The jitter argument has no effect then.
+#define STYLEBLIT_NO_JITTER   0x0008
+
+// Search from seeds spaced 2^level pixels apart (level 0 to 6, 6 being the
+// default) down to single pixels. Fewer levels are cheaper and keep the chunks
+// smaller, e.g. for small exemplars where the coarse chunks rarely fit.
+#define STYLEBLIT_COARSEST_LEVEL(level) ((((level)&7)+1)<<8)
+#define STYLEBLIT_COARSEST_LEVEL_MASK   0x0f00
+
+// Start the search of each 8x8 tile one level above the coarsest level that
+// was accepted in it by the previous call, instead of always at the coarsest
+// one, which skips the coarse levels that detailed regions reject anyway.
+// Tiles without a previous answer (first call, changed settings or inputs)
+// start at the coarsest level. Pixels that pass no level from their start
+// down fall back to the single-pixel match as usual. The NNF is always stored
+// in this mode. Needs multiple render targets, so it is ignored in the WebGL
+// build.
+#define STYLEBLIT_ADAPTIVE_LEVELS 0x0010
+
+// Record the level at which each pixel's seed was accepted, for
+// styleblitStats(). The NNF is always stored in this mode. Like the adaptive
+// levels it needs multiple render targets and is ignored in the WebGL build.
+#define STYLEBLIT_LEVEL_STATS     0x0020
+
+// Run both passes as GL 4.3 compute dispatches. The blend pass then loads
+// each 16x16 tile of the NNF and the mask, plus blendRadius around it, into
+// shared memory once and votes from there instead of fetching (2r+1)^2
+// neighbors per pixel, which pays off for large radii. The NNF is always
+// stored. Only applies to the plain full-frame path: it is ignored together
+// with STYLEBLIT_INCREMENTAL, STYLEBLIT_TEMPORAL, STYLEBLIT_ADAPTIVE_LEVELS,
+// STYLEBLIT_LEVEL_STATS or a tileBudget, for radii whose tile doesn't fit in
+// shared memory (above 24 at the 32KB GL guarantees), on contexts below
+// GL 4.3, on macOS and in the WebGL build.
+#define STYLEBLIT_COMPUTE         0x0040
+
+// Record GPU timestamps around the main and the blend pass, for
+// styleblitPassTimes(). Selecting the tiles and the adaptive start levels
+// counts to the main pass, copying the kept output of the incremental mode to
+// the blend pass. Ignored in the WebGL build, which has no timer queries.
+#define STYLEBLIT_PASS_TIMES      0x0080
+
+// A positive tileBudget time-slices the seed search: the NNF is kept between
+// calls and at most tileBudget 32x32 tiles of it are re-searched per call,
+// tiles where the guide changed first, then those waiting the longest (e.g.
+// since a jitter tick). Changed tiles are read back without waiting for the
+// GPU and so get noticed one call late. The blend pass always runs over the
+// whole composed NNF. STYLEBLIT_INCREMENTAL and STYLEBLIT_TEMPORAL are ignored
+// in this mode.
+
+// By default the best source position for a guide value is read directly off
+// the value, which assumes the source guide is the sphere normal map from
+// data/normals.png. For any other source guide pass texSourceLookup, a table
+// baked by tools/buildlut: 64^3 guide value cells, as 64 slices along blue
+// tiled 8x8 into a 512x512 RGBA8 texture, each texel holding the normalized
+// source position as two 16-bit numbers (r+g*256, b+a*256). Load it without
+// resizing and with GL_NEAREST filtering.
+
+// targetOriginX/Y place the target within a larger image: the seeds are laid
+// out in the coordinates of that image, so targets cut from it with enough
+// overlap (see styleblitTileHalo) get the same NNF where they overlap and can
+// be stitched without seams. The jitter table must stay the same meanwhile,
+// i.e. jitter must be false for all but the first of them.
+
+// The result is drawn into the framebuffer bound at the time of the call.
+
 void styleblit(int    targetWidth,
                int    targetHeight,
                GLuint texTargetNormals,
@@ -20,6 +110,87 @@ void styleblit(int    targetWidth,
                GLuint texSourceStyle,
                float  threshold,
                int    blendRadius,
-               bool   jitter);
+               bool   jitter,
+               int    flags = 0,
+               GLuint texTargetMotion = 0,
+               int    tileBudget = 0,
+               GLuint texSourceLookup = 0,
+               int    targetOriginX = 0,
+               int    targetOriginY = 0);
+
+#ifndef __EMSCRIPTEN__
+// Stylizes numLayers views at once. The target guides are the layers of the
+// GL_TEXTURE_2D_ARRAY texTargetNormals, the results go to the layers of the
+// RGBA GL_TEXTURE_2D_ARRAY texOutput of the same size. The main and the blend
+// pass are each a single instanced draw whose instances a geometry shader
+// sends to the layers, so the setup is paid once per batch rather than once
+// per view. Needs GL 3.2, so it isn't available in the WebGL build.
+void styleblitLayers(int    targetWidth,
+                     int    targetHeight,
+                     int    numLayers,
+                     GLuint texTargetNormals,
+                     int    sourceWidth,
+                     int    sourceHeight,
+                     GLuint texSourceNormals,
+                     GLuint texSourceStyle,
+                     float  threshold,
+                     int    blendRadius,
+                     bool   jitter,
+                     GLuint texOutput,
+                     GLuint texSourceLookup = 0);
+#endif
+
+// Overlap the tiles of a larger target need on each side: the farthest a
+// seed can be from a pixel plus the blend radius.
+int styleblitTileHalo(int blendRadius);
+
+// The NNF computed by the last styleblit call, or 0 if it took the fused path
+// (blendRadius 0 without STYLEBLIT_KEEP_NNF). It's an RGBA8 texture of the
+// target size holding for each pixel the source position it was matched to
+// as two numbers in base 255 (r+g*255,b+a*255). The texture belongs to the
+// library and is overwritten by the next call.
+GLuint styleblitNNF();
+
+#ifndef __EMSCRIPTEN__
+struct StyleblitStats
+{
+  int numPixels;          // masked in pixels
+  int numKept;            // kept from the previous frame by the temporal pass
+  int numFallbacks;       // no level passed, matched pixel by pixel
+  int levels[7];          // accepted at seed spacing 2^level
+  int numChunks;          // connected regions of equal NNF offset
+  int chunkSizes[16];     // chunks of 2^i to 2^(i+1)-1 pixels, the last bin open
+};
+
+// Histograms of how the last styleblit call matched the target, to see what a
+// threshold costs in chunk size for a given style. The last call must have
+// had STYLEBLIT_LEVEL_STATS (or STYLEBLIT_ADAPTIVE_LEVELS) set, otherwise it
+// returns false. Reads the level and NNF textures back and reduces them on
+// the CPU, so it stalls the pipeline; meant for tuning, not for every frame.
+bool styleblitStats(StyleblitStats* out_stats);
+
+// GPU time the main and the blend pass of the last styleblit call took, in
+// milliseconds. When the main pass was fused with the blend pass, all of it
+// counts to the main pass. The last call must have had STYLEBLIT_PASS_TIMES
+// set, otherwise it returns false. Waits for the passes to finish.
+bool styleblitPassTimes(float* out_mainMs,float* out_blendMs);
+#endif
+
+// Blend pass alone: draws the style that texNNF (laid out as above) points to
+// into the bound framebuffer, e.g. to re-blend a stored NNF with a different
+// exemplar. Only the alpha of texTargetMask is read, masked out pixels are
+// filled the same way styleblit fills them.
+void styleblitBlend(int    targetWidth,
+                    int    targetHeight,
+                    GLuint texTargetMask,
+                    GLuint texNNF,
+                    int    sourceWidth,
+                    int    sourceHeight,
+                    GLuint texSourceStyle,
+                    int    blendRadius);
+
+// Forces a full refresh in incremental mode; call it when the contents of the
+// source textures change without their names or sizes changing.
+void styleblitInvalidate();
 
 #endif
@@ -10,9 +10,17 @@ precision highp float;
   #define BLEND_RADIUS 1
 #endif
 
-uniform sampler2D NNF;
 uniform sampler2D sourceStyle;
+#ifdef LAYERED
+uniform sampler2DArray NNF;
+uniform sampler2DArray targetMask;
+flat in int layer;
+vec4 readLayer(sampler2DArray image,vec2 uv) { return texture(image,vec3(uv,float(layer))); }
+#else
+uniform sampler2D NNF;
 uniform sampler2D targetMask;
+vec4 readLayer(sampler2D image,vec2 uv) { return texture2D(image,uv); }
+#endif
 uniform vec2 targetSize;
 uniform vec2 sourceSize;
 
@@ -29,14 +37,14 @@ void main()
   vec4 sumColor = vec4(0.0,0.0,0.0,0.0);
   float sumWeight = 0.0;
   
-  if (texture2D(targetMask,(xy)/targetSize).a>0.0)
+  if (readLayer(targetMask,(xy)/targetSize).a>0.0)
   {
     for(int oy=-BLEND_RADIUS;oy<=+BLEND_RADIUS;oy++)
     for(int ox=-BLEND_RADIUS;ox<=+BLEND_RADIUS;ox++)
     {
-      if (texture2D(targetMask,(xy+vec2(ox,oy))/targetSize).a>0.0)
+      if (readLayer(targetMask,(xy+vec2(ox,oy))/targetSize).a>0.0)
       {
-        sumColor += texture2D(sourceStyle,((unpack(texture2D(NNF,(xy+vec2(ox,oy))/targetSize))-vec2(ox,oy))+vec2(0.5,0.5))/sourceSize);
+        sumColor += texture2D(sourceStyle,((unpack(readLayer(NNF,(xy+vec2(ox,oy))/targetSize))-vec2(ox,oy))+vec2(0.5,0.5))/sourceSize);
         sumWeight += 1.0;
       }
     }
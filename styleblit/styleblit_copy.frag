@@ -0,0 +1,15 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifdef GL_ES
+precision highp float;
+#endif
+
+uniform sampler2D image;
+uniform vec2 targetSize;
+
+void main()
+{
+  gl_FragColor = texture2D(image,gl_FragCoord.xy/targetSize);
+}
@@ -0,0 +1,34 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifdef GL_ES
+precision highp float;
+#endif
+
+#ifndef TILE_SIZE
+  #define TILE_SIZE 32
+#endif
+
+uniform sampler2D target;
+uniform sampler2D previousTarget;
+uniform vec2 targetSize;
+
+void main()
+{
+  vec2 tileOrigin = floor(gl_FragCoord.xy)*float(TILE_SIZE);
+
+  float changed = 0.0;
+
+  for(int y=0;y<TILE_SIZE;y++)
+  {
+    for(int x=0;x<TILE_SIZE;x++)
+    {
+      vec2 uv = (tileOrigin+vec2(x,y)+vec2(0.5,0.5))/targetSize;
+      if (any(notEqual(texture2D(target,uv),texture2D(previousTarget,uv)))) { changed = 1.0; break; }
+    }
+    if (changed>0.0) { break; }
+  }
+
+  gl_FragColor = vec4(changed,0.0,0.0,1.0);
+}
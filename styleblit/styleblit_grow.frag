@@ -0,0 +1,44 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifdef GL_ES
+precision highp float;
+#endif
+
+#ifndef NNF_REACH
+  #define NNF_REACH 4
+#endif
+
+#ifndef OUTPUT_REACH
+  #define OUTPUT_REACH 5
+#endif
+
+uniform sampler2D tiles;
+uniform vec2 tileCount;
+
+// Grows the changed tiles by NNF_REACH tiles into red and by OUTPUT_REACH
+// tiles into green.
+void main()
+{
+  vec2 tile = floor(gl_FragCoord.xy);
+
+  float nnfMask = 0.0;
+  float outputMask = 0.0;
+
+  for(int y=-OUTPUT_REACH;y<=OUTPUT_REACH;y++)
+  {
+    for(int x=-OUTPUT_REACH;x<=OUTPUT_REACH;x++)
+    {
+      vec2 neighbor = tile+vec2(x,y);
+      if (any(lessThan(neighbor,vec2(0.0,0.0))) || any(greaterThanEqual(neighbor,tileCount))) { continue; }
+      if (texture2D(tiles,(neighbor+vec2(0.5,0.5))/tileCount).r>0.0)
+      {
+        outputMask = 1.0;
+        if (x>=-NNF_REACH && x<=NNF_REACH && y>=-NNF_REACH && y<=NNF_REACH) { nnfMask = 1.0; }
+      }
+    }
+  }
+
+  gl_FragColor = vec4(nnfMask,outputMask,0.0,1.0);
+}
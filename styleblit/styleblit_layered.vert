@@ -0,0 +1,15 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#version 150
+
+in vec3 position;
+
+flat out int instance;
+
+void main()
+{
+  gl_Position = vec4(position,1.0);
+  instance = gl_InstanceID;
+}
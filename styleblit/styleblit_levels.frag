@@ -0,0 +1,44 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifdef GL_ES
+precision highp float;
+#endif
+
+#ifndef TILE_SIZE
+  #define TILE_SIZE 8
+#endif
+
+uniform sampler2D levels;
+uniform vec2 targetSize;
+uniform float coarsestLevel;
+
+// Start level of one tile: one above the coarsest level accepted anywhere in
+// it by the previous call, so a tile that gets smoother climbs back up a
+// level per call. Tiles nothing is known about (all masked out, or kept from
+// the previous frame by the temporal pass) start from the top.
+void main()
+{
+  vec2 tileOrigin = floor(gl_FragCoord.xy)*float(TILE_SIZE);
+
+  float coarsest = -1.0;
+  float known = 0.0;
+
+  for(int y=0;y<TILE_SIZE;y++)
+  {
+    for(int x=0;x<TILE_SIZE;x++)
+    {
+      float level = floor(texture2D(levels,(tileOrigin+vec2(x,y)+vec2(0.5,0.5))/targetSize).r*255.0+0.5);
+      if (level<254.0)
+      {
+        coarsest = max(coarsest,level-1.0);
+        known = 1.0;
+      }
+    }
+  }
+
+  float startLevel = (known>0.0) ? min(coarsest+1.0,coarsestLevel) : coarsestLevel;
+
+  gl_FragColor = vec4(startLevel/255.0,0.0,0.0,1.0);
+}
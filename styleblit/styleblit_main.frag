@@ -6,13 +6,65 @@
 precision highp float;
 #endif
 
+#ifdef LAYERED
+uniform sampler2DArray target;
+flat in int layer;
+#else
 uniform sampler2D target;
+#endif
 uniform sampler2D source;
 uniform sampler2D noise;
 uniform vec2 targetSize;
+uniform vec2 targetOrigin;
+#ifdef SOURCE_SIZE
+  #define sourceSize SOURCE_SIZE
+#else
 uniform vec2 sourceSize;
+#endif
 uniform float threshold;
 
+#ifndef COARSEST_LEVEL
+  #define COARSEST_LEVEL 6
+#endif
+
+#ifdef FUSED
+uniform sampler2D sourceStyle;
+#endif
+
+#ifdef LOOKUP_TABLE
+  #define LOOKUP_SIZE 64
+  #define LOOKUP_COLUMNS 8
+uniform sampler2D lookupTable;
+#endif
+
+#ifdef TEMPORAL
+uniform sampler2D previousNNF;
+uniform sampler2D motion;
+uniform float historyValid;
+#endif
+
+#ifdef WRITE_LEVELS
+  // the accepted levels go to the second draw buffer
+  #define gl_FragColor gl_FragData[0]
+#endif
+
+#ifdef COMPUTE
+// Runs as a compute shader (see the main() at the end): each invocation
+// shades one pixel and stores it to outputImage.
+layout(local_size_x=GROUP_SIZE,local_size_y=GROUP_SIZE) in;
+layout(rgba8) uniform writeonly image2D outputImage;
+vec4 fragColor;
+vec4 fragCoord;
+#endif
+
+#ifdef ADAPTIVE_LEVELS
+// the level the search of each LEVEL_TILE_SIZE tile starts at, reduced from
+// the levels the previous call accepted (see styleblit_levels.frag)
+uniform sampler2D startLevels;
+uniform vec2 levelTiles;
+uniform float startLevelsValid;
+#endif
+
 float sum(vec3 xyz) { return xyz.x + xyz.y + xyz.z; }
 
 float frac(float x) { return x-floor(x); }
@@ -25,6 +77,24 @@ vec4 pack(vec2 xy)
               frac(y),floor(y)/255.0);
 }
 
+#ifdef FUSED
+// what the blend pass would read back after pack(xy) went through the RGBA8 NNF
+vec2 roundTrip(vec2 xy)
+{
+  vec4 rgba = floor(clamp(pack(xy),0.0,1.0)*255.0+vec4(0.5,0.5,0.5,0.5))/255.0;
+  return vec2(rgba.r*255.0+rgba.g*255.0*255.0,
+              rgba.b*255.0+rgba.a*255.0*255.0);
+}
+#endif
+
+#ifdef TEMPORAL
+vec2 unpack(vec4 rgba)
+{
+  return floor(vec2(rgba.r*255.0+rgba.g*255.0*255.0,
+                    rgba.b*255.0+rgba.a*255.0*255.0)+vec2(0.5,0.5));
+}
+#endif
+
 bool inside(vec2 uv,vec2 size)
 {
   return (all(greaterThanEqual(uv,vec2(0,0))) && all(lessThan(uv,size)));
@@ -44,6 +114,10 @@ vec2 SeedPoint(vec2 p,float h)
 
 vec2 NearestSeed(vec2 p,float h)
 {
+#ifdef NO_JITTER
+  // on a regular grid the nearest seed is the one of p's own cell
+  return floor(h*(floor(p/h)+vec2(0.5,0.5)));
+#else
   vec2 s_nearest = vec2(0,0);
   float d_nearest = 10000.0;
 
@@ -60,33 +134,131 @@ vec2 NearestSeed(vec2 p,float h)
   }
 
   return s_nearest;
+#endif
 }
 
+#ifdef LAYERED
+vec4 readTarget(vec2 uv) { return texture(target,vec3((uv+vec2(0.5,0.5))/targetSize,float(layer))); }
+#else
+vec4 readTarget(vec2 uv) { return texture2D(target,(uv+vec2(0.5,0.5))/targetSize); }
+#endif
+
 vec3 GS(vec2 uv) { return texture2D(source,(uv+vec2(0.5,0.5))/sourceSize).rgb; }
-vec3 GT(vec2 uv) { return texture2D(target,(uv+vec2(0.5,0.5))/targetSize).rgb; }
+vec3 GT(vec2 uv) { return readTarget(uv).rgb; }
 
 vec2 ArgMinLookup(vec3 targetNormal)
 {
+#ifdef LOOKUP_TABLE
+  vec3 c = floor(clamp(targetNormal,0.0,1.0)*float(LOOKUP_SIZE-1)+vec3(0.5,0.5,0.5));
+  vec2 xy = vec2(mod(c.b,float(LOOKUP_COLUMNS)),floor(c.b/float(LOOKUP_COLUMNS)))*float(LOOKUP_SIZE)+c.rg;
+  vec4 rgba = texture2D(lookupTable,(xy+vec2(0.5,0.5))/float(LOOKUP_SIZE*LOOKUP_COLUMNS));
+  vec2 uv = vec2(rgba.r*255.0+rgba.g*255.0*256.0,
+                 rgba.b*255.0+rgba.a*255.0*256.0)/65535.0;
+  return floor(uv*sourceSize);
+#else
   return vec2(targetNormal.x,targetNormal.y)*sourceSize;
+#endif
+}
+
+// Tries the seed nearest to p at the level with seed spacing h. When it
+// passes the threshold o is set to its source position, the level is only
+// accepted if that lies inside the source.
+bool TryLevel(vec2 p,float h,inout vec2 o)
+{
+  vec2 q = NearestSeed(p+targetOrigin,h)-targetOrigin;
+  vec2 u = ArgMinLookup(GT(q));
+
+  float e = sum(abs(GT(p)-GS(u+(p-q))))*255.0;
+
+  if (e<threshold)
+  {
+    o = u+(p-q); return inside(o,sourceSize);
+  }
+  return false;
+}
+
+// The accepted level is stored plus one, 0 meaning none was accepted, 254
+// that the entry was kept from the previous frame and 255 that the pixel is
+// masked out.
+#ifdef WRITE_LEVELS
+void writeLevel(float level) { gl_FragData[1] = vec4((level+1.0)/255.0,0.0,0.0,1.0); }
+#else
+void writeLevel(float level) { }
+#endif
+
+#ifdef ADAPTIVE_LEVELS
+float StartLevel(vec2 p)
+{
+  if (!(startLevelsValid>0.0)) { return float(COARSEST_LEVEL); }
+  vec2 tile = floor(p/float(LEVEL_TILE_SIZE));
+  return floor(texture2D(startLevels,(tile+vec2(0.5,0.5))/levelTiles).r*255.0+0.5);
 }
+#else
+float StartLevel(vec2 p) { return float(COARSEST_LEVEL); }
+#endif
+
+#ifdef COMPUTE
+  #define main fragmentMain
+#endif
 
 void main()
 {
   vec2 p = gl_FragCoord.xy-vec2(0.5,0.5);
-  vec2 o = ArgMinLookup(GT(p));
 
-  for(int level=6;level>=0;level--)
+#ifdef FUSED
+  if (!(readTarget(p).a>0.0))
   {
-    vec2 q = NearestSeed(p,pow(2.0,float(level)));
-    vec2 u = ArgMinLookup(GT(q));
-    
-    float e = sum(abs(GT(p)-GS(u+(p-q))))*255.0;
-    
-    if (e<threshold)
+    gl_FragColor = texture2D(sourceStyle,vec2(0.0,0.0));
+    return;
+  }
+#endif
+
+#ifdef TEMPORAL
+  // follow the motion vector back to where this surface point was in the
+  // previous frame and keep its NNF entry if it still passes the threshold
+  if (historyValid>0.0)
+  {
+    vec2 r = p-(unpack(texture2D(motion,(p+vec2(0.5,0.5))/targetSize))-vec2(32768.0,32768.0));
+    if (inside(r,targetSize))
     {
-      o = u+(p-q); if (inside(o,sourceSize)) { break; }
+      vec2 h = unpack(texture2D(previousNNF,(r+vec2(0.5,0.5))/targetSize));
+      if (inside(h,sourceSize) && sum(abs(GT(p)-GS(h)))*255.0<threshold)
+      {
+        gl_FragColor = pack(h);
+        writeLevel(253.0);
+        return;
+      }
     }
   }
+#endif
+
+  vec2 o = ArgMinLookup(GT(p));
+  float accepted = -1.0;
+  float startLevel = StartLevel(p);
+
+  for(int level=COARSEST_LEVEL;level>=0;level--)
+  {
+    if (float(level)<=startLevel && TryLevel(p,pow(2.0,float(level)),o)) { accepted = float(level); break; }
+  }
+
+  writeLevel((readTarget(p).a>0.0) ? accepted : 254.0);
 
+#ifdef FUSED
+  gl_FragColor = texture2D(sourceStyle,(roundTrip(o)+vec2(0.5,0.5))/sourceSize);
+#else
   gl_FragColor = pack(o);
+#endif
 }
+
+#ifdef COMPUTE
+#undef main
+void main()
+{
+  ivec2 xy = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(vec2(xy),targetSize))) { return; }
+
+  fragCoord = vec4(vec2(xy)+vec2(0.5,0.5),0.0,1.0);
+  fragmentMain();
+  imageStore(outputImage,xy,fragColor);
+}
+#endif
@@ -0,0 +1,24 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifdef GL_ES
+precision highp float;
+#endif
+
+#ifndef TILE_SIZE
+  #define TILE_SIZE 32
+#endif
+
+uniform sampler2D tiles;
+uniform vec2 tileCount;
+uniform vec4 channel;
+
+// Only the depth of this pass is written: it keeps the pixels of the tiles
+// marked in the selected channel and discards the rest.
+void main()
+{
+  vec2 tile = floor(gl_FragCoord.xy/float(TILE_SIZE));
+  if (dot(texture2D(tiles,(tile+vec2(0.5,0.5))/tileCount),channel)==0.0) { discard; }
+  gl_FragColor = vec4(0.0,0.0,0.0,0.0);
+}
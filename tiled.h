@@ -0,0 +1,272 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+#ifndef TILED_H_
+#define TILED_H_
+
+// Stylization of targets larger than fits in a texture (or in memory). The
+// guide is streamed from a binary PPM or PAM file one strip of tiles at a
+// time, each tile is stylized together with a halo of styleblitTileHalo()
+// pixels around it and with the seeds laid out in global coordinates, so
+// neighboring tiles agree on the NNF where they overlap and the stitched
+// result is the same as if it was rendered at once. The output is written
+// to a PPM file strip by strip, so memory use depends on the tile size and
+// the image width, never on the height.
+// Desktop only.
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "styleblit.h"
+#include "readback.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <vector>
+#include <algorithm>
+
+static bool seekFile(FILE* file,long long offset)
+{
+#if defined(_WIN32)
+  return _fseeki64(file,offset,SEEK_SET)==0;
+#else
+  return fseeko(file,off_t(offset),SEEK_SET)==0;
+#endif
+}
+
+// Guide image read in rows: a P6 PPM (RGB, everything masked in) or a P7 PAM
+// of depth 3 or 4 (RGB_ALPHA, the alpha being the mask), 8 bits per channel.
+struct GuideImage
+{
+  FILE* file;
+  int width;
+  int height;
+  int depth;
+  long long dataOffset;
+};
+
+static bool readHeaderToken(FILE* file,char* token,int maxLength)
+{
+  int c = fgetc(file);
+  while (c!=EOF && (c=='#' || isspace(c)))
+  {
+    if (c=='#') { while (c!=EOF && c!='\n') { c = fgetc(file); } }
+    c = fgetc(file);
+  }
+  int length = 0;
+  while (c!=EOF && !isspace(c) && length<maxLength-1) { token[length++] = c; c = fgetc(file); }
+  token[length] = 0;
+  return length>0;
+}
+
+static bool openGuideImage(const char* fileName,GuideImage* image)
+{
+  image->file = fopen(fileName,"rb");
+  if (!image->file) { return false; }
+
+  char token[64];
+  int maxValue = 0;
+  image->width = image->height = image->depth = 0;
+  readHeaderToken(image->file,token,sizeof(token));
+  if (strcmp(token,"P6")==0)
+  {
+    if (readHeaderToken(image->file,token,sizeof(token))) { image->width = atoi(token); }
+    if (readHeaderToken(image->file,token,sizeof(token))) { image->height = atoi(token); }
+    if (readHeaderToken(image->file,token,sizeof(token))) { maxValue = atoi(token); }
+    image->depth = 3;
+  }
+  else if (strcmp(token,"P7")==0)
+  {
+    while (readHeaderToken(image->file,token,sizeof(token)) && strcmp(token,"ENDHDR")!=0)
+    {
+      char value[64];
+      if (!readHeaderToken(image->file,value,sizeof(value))) { break; }
+      if      (strcmp(token,"WIDTH")==0)  { image->width = atoi(value); }
+      else if (strcmp(token,"HEIGHT")==0) { image->height = atoi(value); }
+      else if (strcmp(token,"DEPTH")==0)  { image->depth = atoi(value); }
+      else if (strcmp(token,"MAXVAL")==0) { maxValue = atoi(value); }
+    }
+    if (strcmp(token,"ENDHDR")!=0) { image->depth = 0; }
+  }
+
+  if (image->width<=0 || image->height<=0 || maxValue!=255 || (image->depth!=3 && image->depth!=4))
+  {
+    fclose(image->file);
+    image->file = 0;
+    return false;
+  }
+
+  image->dataOffset = ftell(image->file);
+  return true;
+}
+
+// Reads the rows y0..y0+count-1 as RGBA, top-down. Rows outside the image
+// repeat the nearest edge row.
+static bool readGuideRows(GuideImage* image,int y0,int count,unsigned char* rgba,std::vector<unsigned char>* row)
+{
+  const int width = image->width;
+  row->resize(size_t(width)*image->depth);
+
+  int loadedRow = -1;
+  for(int i=0;i<count;i++)
+  {
+    const int y = std::min(std::max(y0+i,0),image->height-1);
+    unsigned char* dst = &rgba[size_t(i)*width*4];
+    if (y==loadedRow) { memcpy(dst,dst-size_t(width)*4,size_t(width)*4); continue; }
+
+    if (!seekFile(image->file,image->dataOffset+(long long)y*width*image->depth)) { return false; }
+    if (fread(row->data(),row->size(),1,image->file)!=1) { return false; }
+    const unsigned char* src = row->data();
+    if (image->depth==4) { memcpy(dst,src,size_t(width)*4); }
+    else
+    {
+      for(int x=0;x<width;x++) { dst[x*4+0] = src[x*3+0]; dst[x*4+1] = src[x*3+1]; dst[x*4+2] = src[x*3+2]; dst[x*4+3] = 255; }
+    }
+    loadedRow = y;
+  }
+  return true;
+}
+
+// Stylizes the guide into a PPM file in tiles of at most tileSize pixels,
+// fewer if the tile and its halo wouldn't fit in a texture.
+static bool stylizeTiled(const char* guideFileName,
+                         const char* outputFileName,
+                         int tileSize,
+                         int sourceWidth,
+                         int sourceHeight,
+                         GLuint texSourceNormals,
+                         GLuint texSourceStyle,
+                         float threshold,
+                         int blendRadius)
+{
+  GuideImage guide;
+  if (!openGuideImage(guideFileName,&guide)) { fprintf(stderr,"failed to load %s, expected a binary PPM or PAM\n",guideFileName); return false; }
+  const int width = guide.width;
+  const int height = guide.height;
+
+  FILE* output = fopen(outputFileName,"wb");
+  if (!output) { fprintf(stderr,"failed to create %s\n",outputFileName); fclose(guide.file); return false; }
+  fprintf(output,"P6\n%d %d\n255\n",width,height);
+
+  GLint maxTextureSize = 0;
+  GLint maxViewportSize[2] = { 0,0 };
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE,&maxTextureSize);
+  glGetIntegerv(GL_MAX_VIEWPORT_DIMS,maxViewportSize);
+
+  const int halo = styleblitTileHalo(blendRadius);
+  const int maxSize = std::min(maxTextureSize,std::min(maxViewportSize[0],maxViewportSize[1]));
+  tileSize = std::max(std::min(std::min(tileSize,maxSize-2*halo),std::max(width,height)),1);
+  const int size = tileSize+2*halo;
+  const int tilesX = (width+tileSize-1)/tileSize;
+  const int tilesY = (height+tileSize-1)/tileSize;
+
+  // rows are kept top-down as in the files, the tile is flipped to GL's
+  // bottom-up order when it's cut out
+  std::vector<unsigned char> guideStrip(size_t(size)*width*4);
+  std::vector<unsigned char> guideRow;
+  std::vector<unsigned char> tile(size_t(size)*size*4);
+  std::vector<unsigned char> outputStrip(size_t(tileSize)*width*3);
+
+  GLuint texGuide,texOutput,fboOutput;
+  glGenTextures(1,&texGuide);
+  glBindTexture(GL_TEXTURE_2D,texGuide);
+  glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,size,size,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+
+  glGenTextures(1,&texOutput);
+  glBindTexture(GL_TEXTURE_2D,texOutput);
+  glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,size,size,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+
+  glGenFramebuffers(1,&fboOutput);
+  glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,texOutput,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+
+  ReadbackRing readbackRing;
+  createReadbackRing(&readbackRing,size,size,3);
+
+  int stripHeight = 0;
+  const auto copyCore = [&](int tx,const unsigned char* pixels)
+  {
+    const int x0 = tx*tileSize;
+    const int coreWidth = std::min(tileSize,width-x0);
+    for(int y=0;y<stripHeight;y++)
+    {
+      const unsigned char* src = &pixels[(size_t(size-1-halo-y)*size+halo)*4];
+      unsigned char* dst = &outputStrip[(size_t(y)*width+x0)*3];
+      for(int x=0;x<coreWidth;x++) { memcpy(&dst[x*3],&src[x*4],3); }
+    }
+  };
+
+  bool ok = true;
+  for(int ty=0;ty<tilesY && ok;ty++)
+  {
+    const int y0 = ty*tileSize-halo;
+    stripHeight = std::min(tileSize,height-ty*tileSize);
+    if (!readGuideRows(&guide,y0,size,guideStrip.data(),&guideRow)) { fprintf(stderr,"failed to read %s\n",guideFileName); ok = false; break; }
+
+    for(int tx=0;tx<tilesX;tx++)
+    {
+      const int x0 = tx*tileSize-halo;
+      for(int y=0;y<size;y++)
+      {
+        const unsigned char* src = &guideStrip[size_t(y)*width*4];
+        unsigned char* dst = &tile[size_t(size-1-y)*size*4];
+        for(int x=0;x<size;x++) { memcpy(&dst[x*4],&src[std::min(std::max(x0+x,0),width-1)*4],4); }
+      }
+
+      glBindTexture(GL_TEXTURE_2D,texGuide);
+      glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+      glTexSubImage2D(GL_TEXTURE_2D,0,0,0,size,size,GL_RGBA,GL_UNSIGNED_BYTE,tile.data());
+
+      glBindFramebuffer(GL_FRAMEBUFFER,fboOutput);
+      glViewport(0,0,size,size);
+
+      // the origin is the global position of the tile's bottom-left corner,
+      // in GL's bottom-up coordinates
+      styleblit(size,
+                size,
+                texGuide,
+                sourceWidth,
+                sourceHeight,
+                texSourceNormals,
+                texSourceStyle,
+                threshold,
+                blendRadius,
+                tx==0 && ty==0,
+                0,
+                0,
+                0,
+                0,
+                x0,
+                height-(y0+size));
+
+      readbackFrame(&readbackRing,tx,copyCore);
+      glBindFramebuffer(GL_FRAMEBUFFER,0);
+    }
+    retireReadbacks(&readbackRing,true,copyCore);
+
+    if (fwrite(outputStrip.data(),size_t(stripHeight)*width*3,1,output)!=1) { fprintf(stderr,"failed to write %s\n",outputFileName); ok = false; }
+  }
+
+  destroyReadbackRing(&readbackRing);
+  glDeleteFramebuffers(1,&fboOutput);
+  glDeleteTextures(1,&texOutput);
+  glDeleteTextures(1,&texGuide);
+  fclose(guide.file);
+
+  return (fclose(output)==0) && ok;
+}
+
+#endif
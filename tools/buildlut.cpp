@@ -0,0 +1,239 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+// Offline builder of the inverse-lookup table for arbitrary source guides.
+//
+// usage: buildlut <source-guide.png> <output.tga>
+//
+// The table maps a guide value (r,g,b) to the position of the source pixel
+// whose guide value is the nearest to it. The cube of guide values is sampled
+// in lookupSize^3 cells, stored as lookupSize slices along blue tiled into
+// a lookupColumns x lookupColumns atlas (see styleblit.h for the layout).
+// Guides with fewer channels simply use fewer slices or rows.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cfloat>
+#include <vector>
+#include <algorithm>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+static const int lookupSize = 64;
+static const int lookupColumns = 8;
+
+struct KDPoint
+{
+  float value[3];
+  int   index;
+};
+
+struct KDAxisLess
+{
+  int axis;
+  bool operator()(const KDPoint& a,const KDPoint& b) const { return a.value[axis]<b.value[axis]; }
+};
+
+// The tree is implicit: the node of a range [begin,end) is its middle element
+// and its children are the two halves, split along the axis of largest extent.
+// Every node keeps the bounding box of its range, which prunes far better than
+// the splitting planes alone when the guide values lie on a surface (e.g. the
+// sphere normals) and most queries are far away from it.
+struct KDNode
+{
+  float minValue[3];
+  float maxValue[3];
+  int   axis;
+};
+
+static void buildKDTree(std::vector<KDPoint>& points,std::vector<KDNode>& nodes,int begin,int end)
+{
+  if (end<=begin) { return; }
+
+  const int middle = begin+(end-begin)/2;
+  KDNode& node = nodes[middle];
+
+  for(int k=0;k<3;k++) { node.minValue[k] = +FLT_MAX; node.maxValue[k] = -FLT_MAX; }
+  for(int i=begin;i<end;i++)
+  for(int k=0;k<3;k++)
+  {
+    node.minValue[k] = std::min(node.minValue[k],points[i].value[k]);
+    node.maxValue[k] = std::max(node.maxValue[k],points[i].value[k]);
+  }
+
+  node.axis = 0;
+  for(int k=1;k<3;k++) { if (node.maxValue[k]-node.minValue[k]>node.maxValue[node.axis]-node.minValue[node.axis]) { node.axis = k; } }
+
+  KDAxisLess axisLess = { node.axis };
+  std::nth_element(points.begin()+begin,points.begin()+middle,points.begin()+end,axisLess);
+
+  buildKDTree(points,nodes,begin,middle);
+  buildKDTree(points,nodes,middle+1,end);
+}
+
+static float distanceSquared(const float* a,const float* b)
+{
+  const float dx = a[0]-b[0];
+  const float dy = a[1]-b[1];
+  const float dz = a[2]-b[2];
+  return dx*dx+dy*dy+dz*dz;
+}
+
+static float boxDistanceSquared(const KDNode& node,const float* query)
+{
+  float d = 0.0f;
+  for(int k=0;k<3;k++)
+  {
+    const float e = std::max(std::max(node.minValue[k]-query[k],query[k]-node.maxValue[k]),0.0f);
+    d += e*e;
+  }
+  return d;
+}
+
+static void findNearest(const std::vector<KDPoint>& points,
+                        const std::vector<KDNode>& nodes,
+                        int begin,
+                        int end,
+                        const float* query,
+                        int* inout_nearest,
+                        float* inout_distance)
+{
+  if (end<=begin) { return; }
+
+  const int middle = begin+(end-begin)/2;
+  if (!(boxDistanceSquared(nodes[middle],query)<*inout_distance)) { return; }
+
+  const KDPoint& point = points[middle];
+
+  const float d = distanceSquared(point.value,query);
+  if (d<*inout_distance)
+  {
+    *inout_distance = d;
+    *inout_nearest = middle;
+  }
+
+  const int axis = nodes[middle].axis;
+
+  if (query[axis]<point.value[axis])
+  {
+    findNearest(points,nodes,begin,middle,query,inout_nearest,inout_distance);
+    findNearest(points,nodes,middle+1,end,query,inout_nearest,inout_distance);
+  }
+  else
+  {
+    findNearest(points,nodes,middle+1,end,query,inout_nearest,inout_distance);
+    findNearest(points,nodes,begin,middle,query,inout_nearest,inout_distance);
+  }
+}
+
+// Uncompressed 32-bit TGA with bottom-left origin, so that after loading with
+// stbi_set_flip_vertically_on_load(1) the first row is the bottom one, as in GL.
+static bool writeTGA(const char* fileName,int width,int height,const unsigned char* rgba)
+{
+  FILE* f = fopen(fileName,"wb");
+  if (!f) { return false; }
+
+  unsigned char header[18] = { 0 };
+  header[2]  = 2;
+  header[12] = width&0xFF;
+  header[13] = (width>>8)&0xFF;
+  header[14] = height&0xFF;
+  header[15] = (height>>8)&0xFF;
+  header[16] = 32;
+  header[17] = 8;
+  fwrite(header,1,sizeof(header),f);
+
+  std::vector<unsigned char> bgra(width*height*4);
+  for(int i=0;i<width*height;i++)
+  {
+    bgra[i*4+0] = rgba[i*4+2];
+    bgra[i*4+1] = rgba[i*4+1];
+    bgra[i*4+2] = rgba[i*4+0];
+    bgra[i*4+3] = rgba[i*4+3];
+  }
+  const bool ok = fwrite(bgra.data(),1,bgra.size(),f)==bgra.size();
+
+  fclose(f);
+  return ok;
+}
+
+int main(int argc,char* args[])
+{
+  if (argc!=3)
+  {
+    printf("usage: %s <source-guide.png> <output.tga>\n",args[0]);
+    return 1;
+  }
+
+  int width;
+  int height;
+  stbi_set_flip_vertically_on_load(1);
+  unsigned char* guide = stbi_load(args[1],&width,&height,NULL,4);
+  if (!guide) { printf("failed to load %s\n",args[1]); return 1; }
+
+  // Pixels with zero alpha are outside the exemplar and never matched. Pixels
+  // sharing a guide value are indexed only once (the first one in scanline
+  // order wins), which keeps the tree small for guides with flat regions.
+  std::vector<int> firstPixel(256*256*256,-1);
+  for(int i=0;i<width*height;i++)
+  {
+    if (guide[i*4+3]==0) { continue; }
+    const int key = guide[i*4+0] | (guide[i*4+1]<<8) | (guide[i*4+2]<<16);
+    if (firstPixel[key]<0) { firstPixel[key] = i; }
+  }
+
+  std::vector<KDPoint> points;
+  for(int key=0;key<256*256*256;key++)
+  {
+    if (firstPixel[key]<0) { continue; }
+    KDPoint point;
+    for(int k=0;k<3;k++) { point.value[k] = float((key>>(8*k))&0xFF)/255.0f; }
+    point.index = firstPixel[key];
+    points.push_back(point);
+  }
+  if (points.empty()) { printf("%s has no opaque pixels\n",args[1]); stbi_image_free(guide); return 1; }
+
+  std::vector<KDNode> nodes(points.size());
+  buildKDTree(points,nodes,0,int(points.size()));
+
+  // each texel holds the normalized position of the matching source pixel
+  // as two 16-bit numbers: x in (r,g) and y in (b,a), low byte first
+  const int atlasSize = lookupSize*lookupColumns;
+  std::vector<unsigned char> atlas(atlasSize*atlasSize*4,0);
+  int nearestPoint = 0;
+
+  for(int b=0;b<lookupSize;b++)
+  for(int g=0;g<lookupSize;g++)
+  for(int r=0;r<lookupSize;r++)
+  {
+    const float query[3] = { float(r)/float(lookupSize-1),
+                             float(g)/float(lookupSize-1),
+                             float(b)/float(lookupSize-1) };
+    // neighboring cells mostly share the match, so the previous one gives a
+    // tight initial bound that prunes most of the tree
+    float distance = distanceSquared(points[nearestPoint].value,query)*1.0001f;
+    findNearest(points,nodes,0,int(points.size()),query,&nearestPoint,&distance);
+    const int nearest = points[nearestPoint].index;
+
+    const int x = (nearest%width);
+    const int y = (nearest/width);
+    const int u = int((float(x)+0.5f)/float(width)*65535.0f+0.5f);
+    const int v = int((float(y)+0.5f)/float(height)*65535.0f+0.5f);
+
+    const int ax = (b%lookupColumns)*lookupSize+r;
+    const int ay = (b/lookupColumns)*lookupSize+g;
+    unsigned char* texel = &atlas[(ax+ay*atlasSize)*4];
+    texel[0] = u&0xFF;
+    texel[1] = u>>8;
+    texel[2] = v&0xFF;
+    texel[3] = v>>8;
+  }
+
+  stbi_image_free(guide);
+
+  if (!writeTGA(args[2],atlasSize,atlasSize,atlas.data())) { printf("failed to write %s\n",args[2]); return 1; }
+
+  return 0;
+}
@@ -0,0 +1,155 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+// Packs style exemplars and the source guide into one asset pack.
+//
+// usage: packstyles <output.pack> <image.png>...
+//
+// Every image is stored as RGB at each resolution of assetPackSizes and as
+// RGBA at assetPackIconSize. Images are keyed by their file name without the
+// directory, e.g. "packstyles styles.pack data/*.png", together with the size
+// and modification time of the file so the app can tell when the pack is out
+// of date. Decoding and resizing run on all cores.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "stb_image_resize.h"
+
+#include "assetpack.h"
+
+struct PackedImage
+{
+  AssetPackEntry entry;
+  std::vector<unsigned char> pixels;
+};
+
+struct DecodedImage
+{
+  unsigned char* pixels;
+  int width;
+  int height;
+};
+
+template<typename F>
+static void parallelFor(int count,const F& body)
+{
+  const int numThreads = std::min(count,std::max(int(std::thread::hardware_concurrency()),1));
+  std::atomic<int> next(0);
+  std::vector<std::thread> threads;
+  for(int t=1;t<numThreads;t++)
+  {
+    threads.push_back(std::thread([&]() { for(int i=next++;i<count;i=next++) { body(i); } }));
+  }
+  for(int i=next++;i<count;i=next++) { body(i); }
+  for(int t=0;t<threads.size();t++) { threads[t].join(); }
+}
+
+int main(int argc,char* args[])
+{
+  if (argc<3)
+  {
+    printf("usage: %s <output.pack> <image.png>...\n",args[0]);
+    return 1;
+  }
+
+  const int numFiles = argc-2;
+  std::vector<std::string> names(numFiles);
+  std::vector<uint64_t> sourceSizes(numFiles);
+  std::vector<uint64_t> sourceTimes(numFiles);
+  for(int i=0;i<numFiles;i++)
+  {
+    if (!sourceFileStamp(args[i+2],&sourceSizes[i],&sourceTimes[i])) { printf("failed to load %s\n",args[i+2]); return 1; }
+    names[i] = args[i+2];
+    const size_t slash = names[i].find_last_of("/\\");
+    if (slash!=std::string::npos) { names[i] = names[i].substr(slash+1); }
+    if (names[i].size()>=sizeof(((AssetPackEntry*)0)->name)) { printf("name too long: %s\n",names[i].c_str()); return 1; }
+  }
+
+  // every file is decoded once, as RGBA, and all of its sizes are produced
+  // from that; the RGB entries just drop the alpha after resizing
+  std::vector<DecodedImage> decodedImages(numFiles);
+  stbi_set_flip_vertically_on_load(1);
+  parallelFor(numFiles,[&](int i)
+  {
+    decodedImages[i].pixels = stbi_load(args[i+2],&decodedImages[i].width,&decodedImages[i].height,NULL,4);
+  });
+  for(int i=0;i<numFiles;i++)
+  {
+    if (!decodedImages[i].pixels) { printf("failed to load %s\n",args[i+2]); return 1; }
+  }
+
+  const int numImagesPerFile = assetPackNumSizes+1;
+  std::vector<PackedImage> images(numFiles*numImagesPerFile);
+
+  parallelFor(images.size(),[&](int i)
+  {
+    const DecodedImage& decodedImage = decodedImages[i/numImagesPerFile];
+    const int sizeIndex = i%numImagesPerFile;
+    const int resolution = (sizeIndex<assetPackNumSizes) ? assetPackSizes[sizeIndex] : assetPackIconSize;
+    const int numChannels = (sizeIndex<assetPackNumSizes) ? 3 : 4;
+
+    std::vector<unsigned char> resized(resolution*resolution*4);
+    stbir_resize_uint8(decodedImage.pixels,decodedImage.width,decodedImage.height,0,resized.data(),resolution,resolution,0,4);
+
+    PackedImage& packedImage = images[i];
+    memset(&packedImage.entry,0,sizeof(packedImage.entry));
+    strcpy(packedImage.entry.name,names[i/numImagesPerFile].c_str());
+    packedImage.entry.width = resolution;
+    packedImage.entry.height = resolution;
+    packedImage.entry.numChannels = numChannels;
+    packedImage.entry.size = uint64_t(resolution)*resolution*numChannels;
+    packedImage.entry.sourceSize = sourceSizes[i/numImagesPerFile];
+    packedImage.entry.sourceTime = sourceTimes[i/numImagesPerFile];
+    packedImage.pixels.resize(packedImage.entry.size);
+    for(int j=0;j<resolution*resolution;j++)
+    {
+      for(int k=0;k<numChannels;k++) { packedImage.pixels[j*numChannels+k] = resized[j*4+k]; }
+    }
+  });
+
+  for(int i=0;i<numFiles;i++) { stbi_image_free(decodedImages[i].pixels); }
+
+  uint64_t offset = sizeof(AssetPackHeader)+sizeof(AssetPackEntry)*images.size();
+  for(int i=0;i<images.size();i++)
+  {
+    offset = (offset+assetPackAlignment-1)/assetPackAlignment*assetPackAlignment;
+    images[i].entry.offset = offset;
+    offset += images[i].entry.size;
+  }
+
+  FILE* f = fopen(args[1],"wb");
+  if (!f) { printf("failed to open %s\n",args[1]); return 1; }
+
+  AssetPackHeader header;
+  memcpy(header.magic,assetPackMagic,sizeof(header.magic));
+  header.version = assetPackVersion;
+  header.numEntries = images.size();
+  fwrite(&header,sizeof(header),1,f);
+  for(int i=0;i<images.size();i++) { fwrite(&images[i].entry,sizeof(AssetPackEntry),1,f); }
+
+  uint64_t position = sizeof(AssetPackHeader)+sizeof(AssetPackEntry)*images.size();
+  const unsigned char padding[assetPackAlignment] = { 0 };
+  for(int i=0;i<images.size();i++)
+  {
+    fwrite(padding,1,size_t(images[i].entry.offset-position),f);
+    fwrite(images[i].pixels.data(),1,images[i].pixels.size(),f);
+    position = images[i].entry.offset+images[i].entry.size;
+  }
+
+  const bool ok = (ferror(f)==0);
+  fclose(f);
+  if (!ok) { printf("failed to write %s\n",args[1]); return 1; }
+
+  return 0;
+}
@@ -0,0 +1,77 @@
+// This software is in the public domain. Where that dedication is not
+// recognized, you are granted a perpetual, irrevocable license to copy
+// and modify this file as you see fit.
+
+// Example client of the stylization daemon (see daemonclient.h).
+//
+// usage: stylizeclient <socket> <guide.png> <output.ppm> [style] [frames]
+//
+// Sends the guide to a running "styleblit --daemon <socket>" and writes the
+// stylized result. With frames>1 the same guide is sent repeatedly, which
+// shows the cost of a request once the daemon has the style loaded. POSIX
+// only.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "daemonclient.h"
+
+int main(int argc,char* args[])
+{
+  if (argc<4)
+  {
+    printf("usage: %s <socket> <guide.png> <output.ppm> [style] [frames]\n",args[0]);
+    return 1;
+  }
+
+  const char* style = (argc>4) ? args[4] : "03b.png";
+  const int numFrames = (argc>5) ? std::max(atoi(args[5]),1) : 1;
+
+  // the daemon takes the rows bottom-up, as GL does
+  int width,height;
+  stbi_set_flip_vertically_on_load(1);
+  unsigned char* guide = stbi_load(args[2],&width,&height,NULL,4);
+  if (!guide) { printf("failed to load %s\n",args[2]); return 1; }
+
+  DaemonClient client;
+  if (!connectDaemon(args[1],&client)) { printf("failed to connect to %s\n",args[1]); stbi_image_free(guide); return 1; }
+
+  unsigned char* pixels = 0;
+  for(int i=0;i<numFrames;i++)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    pixels = daemonFrameBuffer(&client,width,height);
+    if (pixels) { memcpy(pixels,guide,size_t(width)*height*4); }
+    if (!pixels || !stylizeOnDaemon(&client,width,height,style,24.0f,1,i==0))
+    {
+      printf("failed to stylize %s\n",args[2]);
+      disconnectDaemon(&client);
+      stbi_image_free(guide);
+      return 1;
+    }
+    const double milliseconds = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+    printf("frame %d: %.2f ms\n",i,milliseconds);
+  }
+  stbi_image_free(guide);
+
+  FILE* f = fopen(args[3],"wb");
+  if (!f) { printf("failed to open %s\n",args[3]); disconnectDaemon(&client); return 1; }
+  fprintf(f,"P6\n%d %d\n255\n",width,height);
+  for(int y=height-1;y>=0;y--)
+  {
+    for(int x=0;x<width;x++) { fwrite(&pixels[(x+y*width)*4],1,3,f); }
+  }
+  const bool ok = (ferror(f)==0);
+  fclose(f);
+
+  disconnectDaemon(&client);
+
+  if (!ok) { printf("failed to write %s\n",args[3]); return 1; }
+  return 0;
+}